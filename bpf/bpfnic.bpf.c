@@ -5,7 +5,10 @@
 #include <bpf_endian.h>
 #include <bpf_helpers.h>
 
+#include "../common/histogram.h"
 #include "../common/packet.h"
+#include "../common/sched.h"
+#include "../common/stats.h"
 
 // Constants for TC hook
 #define TC_ACT_UNSPEC (-1)
@@ -46,7 +49,11 @@ struct {
 	__uint(max_entries, 1);
 } cpus_count SEC(".maps");
 
-/* useful for iterating between CPUs */
+/*
+ * useful for iterating between CPUs. Each rx cpu keeps its own cursor, which
+ * user space seeds with the id of the rx cpu such that rx queues start spread
+ * over the group instead of all bursting onto its first cpu.
+ */
 struct {
 	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
 	__type(key, __u32);
@@ -54,6 +61,21 @@ struct {
 	__uint(max_entries, 1);
 } cpu_iter SEC(".maps");
 
+/**
+ * @brief advances the round-robin `cursor` over a group of `count` cpus. The
+ * cursor is taken modulo `count`, keeping its offset when the group was resized
+ * since it was last advanced.
+ *
+ * @return the index in the group of the selected cpu
+ */
+static __always_inline __u32 round_robin_next(__u32 *cursor, __u32 count)
+{
+	__u32 idx = count ? *cursor % count : 0;
+
+	*cursor = idx + 1 >= count ? 0 : idx + 1;
+	return idx;
+}
+
 /* port number that the benchmark listens on */
 struct {
 	__uint(type, BPF_MAP_TYPE_ARRAY);
@@ -70,33 +92,197 @@ struct {
 	__uint(max_entries, 1);
 } devmap SEC(".maps");
 
-/* counts packets per-cpu */
+/*
+ * Statistics are monotonic and never reset: user space reads them through mmap
+ * and computes per-window deltas.
+ */
+
+/* log-linear histogram of queuing delays in ns, indexed by processing cpu */
 struct {
-	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(map_flags, BPF_F_MMAPABLE);
+	__type(key, __u32);
+	__type(value, struct latency_hist);
+} qd_hist SEC(".maps");
+
+/* counters of the requests processed, indexed by processing cpu */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(map_flags, BPF_F_MMAPABLE);
+	__type(key, __u32);
+	__type(value, struct cpu_counters);
+} cpu_stats SEC(".maps");
+
+/* packets received, indexed by receiving cpu */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(map_flags, BPF_F_MMAPABLE);
+	__type(key, __u32);
+	__type(value, struct rx_counter);
+} rx_packet_ctr SEC(".maps");
+
+/**
+ * @brief counts a packet received by the current cpu. XDP programs do not nest
+ * on a cpu, making it the only writer of its slot: no atomics needed.
+ */
+static __always_inline void count_rx_packet(void)
+{
+	__u32 cpu = bpf_get_smp_processor_id();
+	struct rx_counter *rx_ctr = bpf_map_lookup_elem(&rx_packet_ctr, &cpu);
+
+	if (rx_ctr)
+		rx_ctr->packets += 1;
+}
+
+/**
+ * Number of outstanding requests per destination cpu, i.e. requests that have
+ * been redirected to the cpu but whose processing has not yet completed.
+ * Indexed by cpu id. Incremented by every XDP scheduling program upon redirect
+ * and decremented by the cpumap program once the request has been processed or
+ * handed over to another cpu, or dropped by its full cpumap queue.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
 	__type(key, __u32);
 	__type(value, __u64);
-	__uint(max_entries, 1); // number of packets sent per CPU
-} tx_packet_ctr SEC(".maps");
+} cpu_inflight SEC(".maps");
 
+/**
+ * Outstanding work per destination cpu in microseconds, i.e. the sum of the
+ * service times of the requests redirected to the cpu whose processing has not
+ * yet completed. Indexed by cpu id. Maintained like `cpu_inflight`, except that
+ * drops are only reported in bulk, and thus given back at the average work of
+ * the requests outstanding on the cpu.
+ */
 struct {
 	__uint(type, BPF_MAP_TYPE_ARRAY);
 	__type(key, __u32);
 	__type(value, __u64);
-	__uint(max_entries, 1); // number of packets received by all CPU
-} rx_packet_ctr SEC(".maps");
+} cpu_outstanding_work SEC(".maps");
+
+/* bpf_loop fails without running a single iteration above this many */
+#define BPF_LOOP_MAX_ITERATIONS (1 << 23)
 
 /**
- * Maintains total service time from NIC interrupt to leaving server. Updated
- * on a per-cpu basis by the CPU that performs the redirect back out
+ * @return the service time of the requests of a datagram in microseconds, as
+ * interpreted by the synthetic workload of the cpumap program, i.e. its number
+ * of bpf_loop iterations. Bounded by `summarize_requests`
+ */
+static __always_inline __u64 packet_service_time(struct packet *packet)
+{
+	return (__u64)packet->work * 10;
+}
+
+/// accounts a request redirected to `cpu` as outstanding on it
+static __always_inline void account_redirect(__u32 cpu, __u64 service_time)
+{
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+	if (inflight)
+		__sync_fetch_and_add(inflight, 1);
+
+	__u64 *work = bpf_map_lookup_elem(&cpu_outstanding_work, &cpu);
+	if (work)
+		__sync_fetch_and_add(work, service_time);
+}
+
+#define ATOMIC_SUB_RETRIES 8
+
+/**
+ * @brief subtracts `val` from `*counter` without going below 0, in one
+ * compare-and-swap that is retried if another cpu changed the counter meanwhile
  *
- * Intended to be used for computing average.
+ * @return the value of the counter after the subtraction
+ */
+static __always_inline __u64 atomic_sub_clamped(__u64 *counter, __u64 val)
+{
+	__u64 old, new;
+
+	for (int i = 0; i < ATOMIC_SUB_RETRIES; i++) {
+		old = *(volatile __u64 *)counter;
+		new = old >= val ? old - val : 0;
+		if (__sync_val_compare_and_swap(counter, old, new) == old)
+			return new;
+	}
+	return *(volatile __u64 *)counter;
+}
+
+/**
+ * @brief accounts a request as no longer outstanding on `cpu`. Counters are
+ * clamped at 0 as they may have been reset by user space, or given back by the
+ * drop accounting, since the redirect.
  */
+static __always_inline void account_release(__u32 cpu, __u64 service_time)
+{
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+	if (inflight)
+		atomic_sub_clamped(inflight, 1);
+
+	__u64 *work = bpf_map_lookup_elem(&cpu_outstanding_work, &cpu);
+	if (work)
+		atomic_sub_clamped(work, service_time);
+}
+
+/* sampled scheduling decisions, see `struct sched_event` */
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+	__uint(max_entries, 1 << 22);
+} sched_events SEC(".maps");
+
+/* 0: one in how many scheduling decisions are sampled. 0 disables sampling */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 1);
+} trace_sample_rate SEC(".maps");
+
+/* decisions left before the next sample, per-cpu to keep the hot path unshared */
 struct {
 	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
 	__type(key, __u32);
-	__type(value, __u64);
+	__type(value, __u32);
 	__uint(max_entries, 1);
-} total_srv_time SEC(".maps");
+} trace_countdown SEC(".maps");
+
+/**
+ * @brief emits one in `trace_sample_rate` scheduling decisions into the
+ * `sched_events` ring buffer. A no-op unless sampling is enabled.
+ */
+static __always_inline void trace_sched_decision(struct packet *packet,
+						 __u32 cpu, __u8 class_id)
+{
+	__u32 *rate, *countdown;
+	__u32 key0 = 0;
+
+	rate = bpf_map_lookup_elem(&trace_sample_rate, &key0);
+	if (!rate || *rate == 0)
+		return;
+
+	countdown = bpf_map_lookup_elem(&trace_countdown, &key0);
+	if (!countdown)
+		return;
+	if (*countdown > 1) {
+		*countdown -= 1;
+		return;
+	}
+	*countdown = *rate;
+
+	struct sched_event *event =
+		bpf_ringbuf_reserve(&sched_events, sizeof(*event), 0);
+	if (!event)
+		return;
+
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+
+	event->arrival_ts = packet->reach_server_timestamp;
+	event->cpu = cpu;
+	event->queue_depth = inflight ? *inflight : 0;
+	event->rx_cpu = bpf_get_smp_processor_id();
+	event->class_id = class_id;
+	event->pad = 0;
+	event->work = packet->work > 0xffff ? 0xffff : packet->work;
+	bpf_ringbuf_submit(event, 0);
+}
 
 /**
  * @brief empty function for bpf_loop call
@@ -195,19 +381,157 @@ int bpfnic_xdp(struct xdp_md *ctx)
 	return XDP_PASS;
 }
 
+/**
+ * @brief finds the cpu in `cpus_available` with the fewest outstanding
+ * requests. Stops early upon finding an idle cpu.
+ *
+ * @return 0 on success with the chosen cpu id in `cpu_out`, -1 on failure
+ */
+static __always_inline int select_least_loaded_cpu(__u32 *cpu_out)
+{
+	__u64 min_inflight = ~0ULL;
+	__u32 *cpu_count, *cpu;
+	__u32 key0 = 0;
+	int ret = -1;
+
+	cpu_count = bpf_map_lookup_elem(&cpus_count, &key0);
+	if (!cpu_count)
+		return -1;
+
+	for (__u32 i = 0; i < MAX_SCHED_CPUS; i++) {
+		__u32 idx = i;
+		if (idx >= *cpu_count)
+			break;
+
+		cpu = bpf_map_lookup_elem(&cpus_available, &idx);
+		if (!cpu)
+			break;
+
+		__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, cpu);
+		if (!inflight)
+			continue;
+
+		if (*inflight < min_inflight) {
+			min_inflight = *inflight;
+			*cpu_out = *cpu;
+			ret = 0;
+			if (min_inflight == 0)
+				break;
+		}
+	}
+
+	return ret;
+}
+
+/* work stealing configuration, see `struct steal_config` */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct steal_config);
+	__uint(max_entries, 1);
+} steal_cfg SEC(".maps");
+
+/**
+ * @brief XDP metadata carried by a request handed over between cpumap
+ * programs. The magic tells it apart from metadata left by anything else.
+ */
+struct steal_meta {
+	__u16 magic;
+	__u16 hops;
+};
+
+#define STEAL_META_MAGIC 0xb5f1
+
+/**
+ * @brief hands the request over to an idle cpu of `cpus_available` when `cpu`
+ * has at least `queue_threshold` outstanding requests, and the request has
+ * been handed over fewer than `max_hops` times. The hop count travels in the
+ * XDP metadata of the request.
+ *
+ * @return XDP_REDIRECT if the request was handed over, XDP_PASS otherwise
+ */
+static __always_inline int try_steal(struct xdp_md *ctx, __u32 cpu)
+{
+	struct steal_config *cfg;
+	struct steal_meta *meta;
+	__u32 key0 = 0;
+	__u32 peer;
+	__u16 hops = 0;
+
+	cfg = bpf_map_lookup_elem(&steal_cfg, &key0);
+	if (!cfg || cfg->queue_threshold == 0)
+		return XDP_PASS;
+
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+	if (!inflight || *inflight < cfg->queue_threshold)
+		return XDP_PASS;
+
+	meta = (void *)(long)ctx->data_meta;
+	if ((void *)(meta + 1) <= (void *)(long)ctx->data &&
+	    meta->magic == STEAL_META_MAGIC)
+		hops = meta->hops;
+	if (hops >= cfg->max_hops)
+		return XDP_PASS;
+
+	if (select_least_loaded_cpu(&peer) < 0 || peer == cpu)
+		return XDP_PASS;
+	__u64 *peer_inflight = bpf_map_lookup_elem(&cpu_inflight, &peer);
+	if (!peer_inflight || *peer_inflight > 0)
+		return XDP_PASS;
+
+	if (hops == 0 && bpf_xdp_adjust_meta(ctx, -(int)sizeof(*meta)))
+		return XDP_PASS;
+
+	// packet pointers are invalidated by adjusting the metadata
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	meta = (void *)(long)ctx->data_meta;
+	if ((void *)(meta + 1) > data)
+		return XDP_PASS;
+
+	// the parser assumes `ethhdr | iphdr | udphdr | struct packet`
+	struct packet *packet = data + sizeof(struct ethhdr) +
+				sizeof(struct iphdr) + sizeof(struct udphdr);
+	if ((void *)(packet + 1) > data_end)
+		return XDP_PASS;
+
+	if (bpf_redirect_map(&cpu_map, peer, 0) != XDP_REDIRECT)
+		return XDP_PASS;
+
+	meta->magic = STEAL_META_MAGIC;
+	meta->hops = hops + 1;
+
+	__u64 service_time = packet_service_time(packet);
+	account_release(cpu, service_time);
+	account_redirect(peer, service_time);
+
+	struct cpu_counters *stats = bpf_map_lookup_elem(&cpu_stats, &cpu);
+	if (stats)
+		stats->stolen += 1;
+	return XDP_REDIRECT;
+}
+
 /**
  * BPF program run on a receiving CPU
  */
 SEC("xdp/cpumap")
 int bpfnic_benchmark_cpu_func(struct xdp_md *ctx)
 {
-	__u64 *tx_packets;
-	__u64 *curr_total_queue_delay;
+	struct cpu_counters *stats;
+	__u32 cpu = bpf_get_smp_processor_id();
 	__u32 key0 = 0;
 	void *data = (void *)(long)ctx->data;
 	void *data_end = (void *)(long)ctx->data_end;
 	struct hdr_cursor nh = { .pos = data };
 
+	// before parsing, which turns the packet into a reply
+	if (try_steal(ctx, cpu) == XDP_REDIRECT)
+		return XDP_REDIRECT;
+
+	data = (void *)(long)ctx->data;
+	data_end = (void *)(long)ctx->data_end;
+	nh.pos = data;
+
 	if (bpfnic_benchmark_parse_and_swap(ctx, &nh) < 0)
 		return XDP_PASS;
 
@@ -217,20 +541,34 @@ int bpfnic_benchmark_cpu_func(struct xdp_md *ctx)
 
 	packet->leave_server_timestamp = bpf_ktime_get_ns();
 
-	curr_total_queue_delay = bpf_map_lookup_elem(&total_srv_time, &key0);
-	if (curr_total_queue_delay) {
-		*curr_total_queue_delay += packet->leave_server_timestamp -
-					   packet->reach_server_timestamp;
-	}
+	__u64 queue_delay = packet->leave_server_timestamp -
+			    packet->reach_server_timestamp;
 
-	// loop for 10 times the data portion of the packet
-	bpf_loop(((int)packet->data) * 10, _empty_loop_func, NULL, 0);
+	// the cpumap kthread is bound to `cpu`, making it the only writer of its
+	// slots: no atomics needed
+	struct latency_hist *hist = bpf_map_lookup_elem(&qd_hist, &cpu);
+	if (hist) {
+		__u32 bucket = hist_bucket(queue_delay);
+		if (bucket < HIST_NUM_BUCKETS)
+			hist->buckets[bucket] += 1;
+	}
 
-	tx_packets = bpf_map_lookup_elem(&tx_packet_ctr, &key0);
-	if (tx_packets) {
-		*tx_packets += 1;
+	// loop for 10 times the service time of all requests of the packet
+	__u64 service_time = packet_service_time(packet);
+	bpf_loop(service_time, _empty_loop_func, NULL, 0);
+
+	stats = bpf_map_lookup_elem(&cpu_stats, &cpu);
+	if (stats) {
+		stats->tx_packets += 1;
+		stats->srv_time += queue_delay;
+		stats->work += service_time;
+		stats->busy_time +=
+			bpf_ktime_get_ns() - packet->leave_server_timestamp;
 	}
 
+	// request is done, no longer outstanding on this cpu
+	account_release(cpu, service_time);
+
 	// debug bpf_redirect_map
 	long ret = bpf_redirect_map(&devmap, key0, 0);
 	if (ret != XDP_REDIRECT)
@@ -239,12 +577,65 @@ int bpfnic_benchmark_cpu_func(struct xdp_md *ctx)
 	return ret;
 }
 
+/**
+ * @brief fills in the `work` and `deadline_us` summaries of the requests
+ * following `packet`
+ *
+ * @return `true` iff the packet is of the current version, holds all of its
+ * requests, and their work can be run by a single bpf_loop call
+ */
+static __always_inline bool summarize_requests(struct packet *packet,
+						void *data_end)
+{
+	struct packet_request *req = (struct packet_request *)(packet + 1);
+	__u32 deadline_us = 0;
+	__u32 work = 0;
+
+	if (packet->version != PACKET_VERSION || packet->num_requests == 0 ||
+	    packet->num_requests > PACKET_MAX_REQUESTS)
+		return false;
+
+	for (__u32 i = 0; i < PACKET_MAX_REQUESTS; i++) {
+		if (i >= packet->num_requests)
+			break;
+		if ((void *)(req + 1) > data_end)
+			return false;
+
+		work += req->service_time;
+		if (req->deadline_us &&
+		    (!deadline_us || req->deadline_us < deadline_us))
+			deadline_us = req->deadline_us;
+		req++;
+	}
+
+	packet->work = work;
+	packet->deadline_us = deadline_us;
+	return packet_service_time(packet) <= BPF_LOOP_MAX_ITERATIONS;
+}
+
+/**
+ * @brief sets `flags` on all requests following `packet`
+ */
+static __always_inline void flag_requests(struct packet *packet,
+					  void *data_end, __u8 flags)
+{
+	struct packet_request *req = (struct packet_request *)(packet + 1);
+
+	packet->flags |= flags;
+	for (__u32 i = 0; i < PACKET_MAX_REQUESTS; i++) {
+		if (i >= packet->num_requests || (void *)(req + 1) > data_end)
+			break;
+		req->flags |= flags;
+		req++;
+	}
+}
+
 /**
  * Parses and timestamps packet with arrival time. Sets header cursor to the
  * beginning of the embedded `struct packet`
  *
  * @return `true` iff packet was going to/leaving benchmark program by reading
- * UDP port numbers
+ * UDP port numbers, and is well-formed
  */
 static __always_inline int
 bpfnic_benchmark_parse_and_timestamp_packet(struct xdp_md *ctx,
@@ -288,27 +679,95 @@ bpfnic_benchmark_parse_and_timestamp_packet(struct xdp_md *ctx,
 		return false;
 	nh->pos = packet;
 
+	if (!summarize_requests(packet, data_end))
+		return false;
+
 	packet->reach_server_timestamp = bpf_ktime_get_ns();
 	return true;
 }
 
+/* admission control configuration, see `struct admission_config` */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, struct admission_config);
+	__uint(max_entries, 1);
+} admission_cfg SEC(".maps");
+
+/**
+ * @return `true` iff a request redirected to `cpu` is predicted to start
+ * within the admission deadline, i.e. the outstanding work of `cpu` is below it.
+ * A cpu without outstanding requests always admits, such that work left on it
+ * by inexact accounting cannot make it refuse all requests for good
+ */
+static __always_inline bool admit_request(__u32 cpu)
+{
+	struct admission_config *cfg;
+	__u32 key0 = 0;
+
+	cfg = bpf_map_lookup_elem(&admission_cfg, &key0);
+	if (!cfg || cfg->deadline_us == 0)
+		return true;
+
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+	if (!inflight || *inflight == 0)
+		return true;
+
+	__u64 *work = bpf_map_lookup_elem(&cpu_outstanding_work, &cpu);
+	return !work || *work <= cfg->deadline_us;
+}
+
+/**
+ * @brief sheds a request refused by `admit_request`, which must have been
+ * parsed and timestamped. Counted per rx cpu like received packets.
+ *
+ * @return XDP_TX with the request turned into an overloaded reply if
+ * `admission_cfg` says so, XDP_DROP otherwise
+ */
+static __always_inline int shed_request(struct xdp_md *ctx)
+{
+	struct admission_config *cfg;
+	__u32 cpu = bpf_get_smp_processor_id();
+	__u32 key0 = 0;
+
+	struct rx_counter *rx_ctr = bpf_map_lookup_elem(&rx_packet_ctr, &cpu);
+	if (rx_ctr)
+		rx_ctr->shed += 1;
+
+	cfg = bpf_map_lookup_elem(&admission_cfg, &key0);
+	if (!cfg || !cfg->reply)
+		return XDP_DROP;
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (bpfnic_benchmark_parse_and_swap(ctx, &nh) < 0)
+		return XDP_DROP;
+
+	struct packet *packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	// no queuing delay: the request was never queued
+	packet->leave_server_timestamp = packet->reach_server_timestamp;
+	flag_requests(packet, data_end, PACKET_FLAG_OVERLOADED);
+	return XDP_TX;
+}
+
 SEC("xdp")
 int bpf_redirect_roundrobin(struct xdp_md *ctx)
 {
 	__u32 *cpu_selected, *cpu_iterator, *cpu_count;
 	struct packet *packet;
-	__u64 *rx_ctr;
 	__u32 cpu_dest = 0;
 	__u32 key0 = 0;
 	__u32 cpu_idx;
 
-	// increment received packets atomically
-	rx_ctr = bpf_map_lookup_elem(&rx_packet_ctr, &key0);
-	if (rx_ctr)
-		__sync_fetch_and_add(rx_ctr, 1);
+	count_rx_packet();
 
 	void *data = (void *)(long)ctx->data;
-	void *data_end = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
 	struct hdr_cursor nh = { .pos = data };
 
 	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh)) {
@@ -316,6 +775,10 @@ int bpf_redirect_roundrobin(struct xdp_md *ctx)
 		return XDP_PASS;
 	}
 
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
 	// TODO: make redirection decision
 	cpu_iterator = bpf_map_lookup_elem(&cpu_iter, &key0);
 	if (!cpu_iterator)
@@ -324,31 +787,262 @@ int bpf_redirect_roundrobin(struct xdp_md *ctx)
 	if (!cpu_count)
 		return XDP_DROP;
 
-	cpu_idx = *cpu_iterator;
-	if (cpu_idx + 1 >= *cpu_count){
-		*cpu_iterator = 0;
-	} else {
-		*cpu_iterator = cpu_idx + 1;
-	}
-	//*cpu_id = (cpu_idx + 1) % *max_cpu ;
-		
+	cpu_idx = round_robin_next(cpu_iterator, *cpu_count);
 
+	// entries hold cpu ids, and cpu 0 is a valid destination
 	__u32 *cpu_avail = bpf_map_lookup_elem(&cpus_available, &cpu_idx);
 	if (!cpu_avail)
 		return XDP_DROP;
-	if (*cpu_avail == 0){
-		bpf_printk("cpu%d not available", cpu_idx);
-		return XDP_ABORTED;
-	}
+	cpu_dest = *cpu_avail;
 
+	if (!admit_request(cpu_dest))
+		return shed_request(ctx);
 
-	long ret = bpf_redirect_map(&cpu_map, cpu_idx, 0);
+	long ret = bpf_redirect_map(&cpu_map, cpu_dest, 0);
 	if (ret != XDP_REDIRECT){
 		bpf_printk("bpf_redirect_map (devmap) failure: ret code = %d", ret);
 		return XDP_DROP;
 	}
+	trace_sched_decision(packet, cpu_dest, 0);
+	account_redirect(cpu_dest, packet_service_time(packet));
+	return ret;
+
+}
+
+/**
+ * Join-shortest-queue: redirects each packet to the cpu in `cpus_available`
+ * with the fewest outstanding requests, so that a long request does not block
+ * short ones while other cpus sit idle.
+ */
+SEC("xdp")
+int bpf_redirect_jsq(struct xdp_md *ctx)
+{
+	struct packet *packet;
+	__u32 cpu_dest = 0;
+
+	count_rx_packet();
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh))
+		return XDP_PASS;
+
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	if (select_least_loaded_cpu(&cpu_dest) < 0)
+		return XDP_DROP;
+
+	if (!admit_request(cpu_dest))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, cpu_dest, 0);
+	if (ret != XDP_REDIRECT) {
+		bpf_printk("bpf_redirect_map (cpumap) failure: ret code = %d",
+			   ret);
+		return XDP_DROP;
+	}
+
+	trace_sched_decision(packet, cpu_dest, 0);
+	account_redirect(cpu_dest, packet_service_time(packet));
+	return ret;
+}
+
+/**
+ * Power-of-two-choices: samples two distinct cpus from `cpus_available` and
+ * redirects the packet to the one with the least outstanding work. Gives
+ * near-JSQ tail latency at a constant cost per packet.
+ */
+SEC("xdp")
+int bpf_redirect_p2c(struct xdp_md *ctx)
+{
+	__u32 *cpu_count, *cpu_a, *cpu_b;
+	__u64 *work_a, *work_b;
+	struct packet *packet;
+	__u32 idx_a, idx_b;
+	__u32 cpu_dest;
+	__u32 key0 = 0;
+
+	count_rx_packet();
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh))
+		return XDP_PASS;
+
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	cpu_count = bpf_map_lookup_elem(&cpus_count, &key0);
+	if (!cpu_count || *cpu_count == 0)
+		return XDP_DROP;
+
+	// the second choice is drawn among the remaining cpus so that both differ
+	idx_a = bpf_get_prandom_u32() % *cpu_count;
+	idx_b = idx_a;
+	if (*cpu_count > 1)
+		idx_b = (idx_a + 1 + bpf_get_prandom_u32() % (*cpu_count - 1)) %
+			*cpu_count;
+
+	cpu_a = bpf_map_lookup_elem(&cpus_available, &idx_a);
+	if (!cpu_a)
+		return XDP_DROP;
+	cpu_b = bpf_map_lookup_elem(&cpus_available, &idx_b);
+	if (!cpu_b)
+		return XDP_DROP;
+
+	work_a = bpf_map_lookup_elem(&cpu_outstanding_work, cpu_a);
+	if (!work_a)
+		return XDP_DROP;
+	work_b = bpf_map_lookup_elem(&cpu_outstanding_work, cpu_b);
+	if (!work_b)
+		return XDP_DROP;
+
+	cpu_dest = *work_b < *work_a ? *cpu_b : *cpu_a;
+
+	if (!admit_request(cpu_dest))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, cpu_dest, 0);
+	if (ret != XDP_REDIRECT) {
+		bpf_printk("bpf_redirect_map (cpumap) failure: ret code = %d",
+			   ret);
+		return XDP_DROP;
+	}
+
+	trace_sched_decision(packet, cpu_dest, 0);
+	account_redirect(cpu_dest, packet_service_time(packet));
 	return ret;
+}
+
+/*
+ * 0: outstanding requests of the hashed cpu from which the flow-hash policy
+ * spills a packet to the least loaded cpu instead. 0 never spills.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 1);
+} hash_spill_threshold SEC(".maps");
+
+/**
+ * @return a hash of the udp 5-tuple of a packet, with the murmur3 finalizer
+ * spreading all input bits over the result
+ */
+static __always_inline __u64 flow_hash(struct iphdr *iphdr,
+				       struct udphdr *udphdr)
+{
+	__u64 h = ((__u64)iphdr->saddr << 32) | iphdr->daddr;
+
+	h ^= (((__u64)udphdr->source << 16) | udphdr->dest) << 8 |
+	     iphdr->protocol;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * @brief jump consistent hash (Lamping & Veach) of `key` over `num_buckets`
+ * buckets. Growing or shrinking the bucket count by one at the end only moves
+ * 1/num_buckets of the keys. Every round strictly increases the candidate
+ * bucket, bounding the loop by the number of buckets.
+ *
+ * @return the bucket of `key` in [0, num_buckets)
+ */
+static __always_inline __u32 jump_consistent_hash(__u64 key,
+						  __u32 num_buckets)
+{
+	__u64 b = 0, j = 0;
+
+	for (__u32 i = 0; i < MAX_SCHED_CPUS; i++) {
+		if (j >= num_buckets)
+			break;
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = ((b + 1) << 31) / ((key >> 33) + 1);
+	}
+	return b;
+}
+
+/**
+ * Flow affinity: steers every packet of a flow to the same cpu by jump
+ * consistent hashing its 5-tuple over the first `cpus_count` cpus of
+ * `cpus_available`, so that resizing the core group only moves the flows of
+ * the added or removed cpu. A packet whose hashed cpu has more outstanding
+ * requests than `hash_spill_threshold` spills over to the least loaded cpu.
+ */
+SEC("xdp")
+int bpf_redirect_hash(struct xdp_md *ctx)
+{
+	__u32 *cpu_count, *cpu, *spill_threshold;
+	__u64 *inflight;
+	struct packet *packet;
+	__u32 cpu_dest, idx;
+	__u8 spilled = 0;
+	__u32 key0 = 0;
+
+	count_rx_packet();
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh))
+		return XDP_PASS;
+
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	// the parser assumes `ethhdr | iphdr | udphdr | struct packet`
+	struct iphdr *iphdr = data + sizeof(struct ethhdr);
+	struct udphdr *udphdr = (struct udphdr *)(iphdr + 1);
+	if (udphdr + 1 > data_end)
+		return XDP_DROP;
+
+	cpu_count = bpf_map_lookup_elem(&cpus_count, &key0);
+	if (!cpu_count || *cpu_count == 0)
+		return XDP_DROP;
+
+	idx = jump_consistent_hash(flow_hash(iphdr, udphdr), *cpu_count);
+	cpu = bpf_map_lookup_elem(&cpus_available, &idx);
+	if (!cpu)
+		return XDP_DROP;
+	cpu_dest = *cpu;
+
+	inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu_dest);
+	if (!inflight)
+		return XDP_DROP;
+
+	spill_threshold = bpf_map_lookup_elem(&hash_spill_threshold, &key0);
+	if (spill_threshold && *spill_threshold > 0 &&
+	    *inflight >= *spill_threshold &&
+	    select_least_loaded_cpu(&cpu_dest) == 0)
+		spilled = 1;
+
+	if (!admit_request(cpu_dest))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, cpu_dest, 0);
+	if (ret != XDP_REDIRECT) {
+		bpf_printk("bpf_redirect_map (cpumap) failure: ret code = %d",
+			   ret);
+		return XDP_DROP;
+	}
 
+	trace_sched_decision(packet, cpu_dest, spilled);
+	account_redirect(cpu_dest, packet_service_time(packet));
+	return ret;
 }
 
 /* array of cpus available for processing long requests */
@@ -367,6 +1061,7 @@ struct {
 
 // 0: short request iterator
 // 1: long request iterator
+// seeded like `cpu_iter`
 struct {
 	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
 	__type(key, __u32);
@@ -394,11 +1089,8 @@ int bpf_redirect_roundrobin_core_separated(struct xdp_md *ctx)
 	__u32 key0 = 0;
 	__u32 key1 = 1;
 	__u32 cpu_idx;
-	__u64 *rx_ctr;
 
-	rx_ctr = bpf_map_lookup_elem(&rx_packet_ctr, &key0);
-	if (rx_ctr)
-		__sync_fetch_and_add(rx_ctr, 1);
+	count_rx_packet();
 
 	void *data = (void *)(long)ctx->data;
 	void *data_end = (void *)(long)ctx->data_end;
@@ -408,7 +1100,6 @@ int bpf_redirect_roundrobin_core_separated(struct xdp_md *ctx)
 		return XDP_PASS;
 
 	// TODO: make redirection decision
-	int is_short = 1;
 	packet  = nh.pos;
 	if (packet +1 > data_end ){
 		return XDP_DROP;
@@ -419,56 +1110,352 @@ int bpf_redirect_roundrobin_core_separated(struct xdp_md *ctx)
 	cpu_count_long = bpf_map_lookup_elem(&cpu_count_core_separated, &key1);
 	if (!cpu_count_long)
 		return XDP_DROP;
-	if(packet->data < 10){
+	// a batch is as long as the work of all of its requests
+	if(packet->work < 10){
 		selected_map = &cpus_available_short_reqs;
 		cpu_iterator_short = bpf_map_lookup_elem(&cpu_iter_core_separated, &key0);
 		if (!cpu_iterator_short)
 			return XDP_DROP;
 
-		cpu_idx = *cpu_iterator_short;
-		if (cpu_idx + 1 >= *cpu_count_short){
-			*cpu_iterator_short = 0;
-		} else {
-			*cpu_iterator_short = cpu_idx + 1;
-		}
-		bpf_printk("received short packet (data=%d), scheduled to run at cpu: %d", packet->data, cpu_idx);
+		cpu_idx = round_robin_next(cpu_iterator_short, *cpu_count_short);
 	} else {
-		is_short = 0;
 		selected_map = &cpus_available_long_reqs;
 		cpu_iterator_long = bpf_map_lookup_elem(&cpu_iter_core_separated, &key1);
 		if (!cpu_iterator_long)
 			return XDP_DROP;
 
-		cpu_idx = *cpu_iterator_long;
-		if (cpu_idx + 1 >= *cpu_count_long){
-			*cpu_iterator_long = 0;
-		} else {
-			*cpu_iterator_long = cpu_idx + 1;
-		}
-		//cpu_idx += *cpu_count_short; //offset 
-		bpf_printk("received long packet (data=%d), scheduled to run at cpu: %d", packet->data, cpu_idx);
+		cpu_idx = round_robin_next(cpu_iterator_long, *cpu_count_long);
 	}
 
+	// entries hold the id of the cpu, as the groups are resized at runtime by
+	// moving cpus between both maps
 	__u32 *cpu_avail = bpf_map_lookup_elem(selected_map, &cpu_idx);
 	if (!cpu_avail)
 		return XDP_DROP;
-	if (*cpu_avail == 0){
-		bpf_printk("cpu%d not available, intended task is short?: %d", cpu_idx, is_short);
-		return XDP_ABORTED;
-	}
 
-	if(is_short == 0){
-		cpu_idx += *cpu_count_short;
-	}
-	long ret = bpf_redirect_map(&cpu_map, cpu_idx, 0);
+	if (!admit_request(*cpu_avail))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, *cpu_avail, 0);
 	if (ret != XDP_REDIRECT){
 		bpf_printk("bpf_redirect_map (devmap) failure: ret code = %d", ret);
 		return XDP_DROP;
 	}
+	trace_sched_decision(packet, *cpu_avail,
+			     selected_map == &cpus_available_long_reqs);
+	account_redirect(*cpu_avail, packet_service_time(packet));
 	return ret;
 	
 }
 
+/*
+ * 0: deadline in us at or below which the deadline-aware policy treats a
+ * request as latency-critical
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 1);
+} edf_tight_deadline SEC(".maps");
+
+/**
+ * @brief finds the cpu with the least outstanding work among the first `count`
+ * cpus of the group `group_map`
+ *
+ * @return 0 on success with the cpu id in `cpu_out` and its outstanding work in
+ * `work_out`, -1 on failure
+ */
+static __always_inline int select_least_work_cpu(void *group_map, __u32 count,
+						 __u32 *cpu_out,
+						 __u64 *work_out)
+{
+	__u64 min_work = ~0ULL;
+	int ret = -1;
+
+	for (__u32 i = 0; i < MAX_SCHED_CPUS; i++) {
+		__u32 idx = i;
+		if (idx >= count)
+			break;
+
+		__u32 *cpu = bpf_map_lookup_elem(group_map, &idx);
+		if (!cpu)
+			break;
+
+		__u64 *work = bpf_map_lookup_elem(&cpu_outstanding_work, cpu);
+		if (!work)
+			continue;
+
+		if (*work < min_work) {
+			min_work = *work;
+			*cpu_out = *cpu;
+			ret = 0;
+			if (min_work == 0)
+				break;
+		}
+	}
+
+	*work_out = min_work;
+	return ret;
+}
+
+/**
+ * Deadline-aware scheduling over the core-separated groups, where the short
+ * group holds the low-latency cpus and the long group the best-effort ones.
+ * Requests whose deadline is at most `edf_tight_deadline` go to the low-latency
+ * cpu with the shortest backlog, or to the best-effort one with the shortest
+ * backlog if the former would miss the deadline and the latter has less work.
+ * Best-effort requests and loose deadlines are round-robined over the
+ * best-effort group.
+ */
+SEC("xdp")
+int bpf_redirect_edf(struct xdp_md *ctx)
+{
+	__u32 *cpu_count_fast, *cpu_count_best_effort, *tight_deadline;
+	__u32 *cpu_iterator, *cpu;
+	struct packet *packet;
+	__u64 work, work_best_effort;
+	__u32 cpu_dest, cpu_best_effort;
+	__u32 key0 = 0;
+	__u32 key1 = 1;
+	__u32 cpu_idx;
+	__u8 tight;
+
+	count_rx_packet();
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh))
+		return XDP_PASS;
+
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	cpu_count_fast = bpf_map_lookup_elem(&cpu_count_core_separated, &key0);
+	if (!cpu_count_fast)
+		return XDP_DROP;
+	cpu_count_best_effort =
+		bpf_map_lookup_elem(&cpu_count_core_separated, &key1);
+	if (!cpu_count_best_effort)
+		return XDP_DROP;
+	tight_deadline = bpf_map_lookup_elem(&edf_tight_deadline, &key0);
+	if (!tight_deadline)
+		return XDP_DROP;
+
+	tight = packet->deadline_us > 0 &&
+		packet->deadline_us <= *tight_deadline;
+
+	if (tight) {
+		if (select_least_work_cpu(&cpus_available_short_reqs,
+					  *cpu_count_fast, &cpu_dest,
+					  &work) < 0)
+			return XDP_DROP;
+
+		if (work > packet->deadline_us &&
+		    select_least_work_cpu(&cpus_available_long_reqs,
+					  *cpu_count_best_effort,
+					  &cpu_best_effort,
+					  &work_best_effort) == 0 &&
+		    work_best_effort < work)
+			cpu_dest = cpu_best_effort;
+	} else {
+		cpu_iterator =
+			bpf_map_lookup_elem(&cpu_iter_core_separated, &key1);
+		if (!cpu_iterator)
+			return XDP_DROP;
+
+		cpu_idx = round_robin_next(cpu_iterator,
+					   *cpu_count_best_effort);
+		cpu = bpf_map_lookup_elem(&cpus_available_long_reqs, &cpu_idx);
+		if (!cpu)
+			return XDP_DROP;
+		cpu_dest = *cpu;
+	}
+
+	if (!admit_request(cpu_dest))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, cpu_dest, 0);
+	if (ret != XDP_REDIRECT) {
+		bpf_printk("bpf_redirect_map (cpumap) failure: ret code = %d",
+			   ret);
+		return XDP_DROP;
+	}
+
+	trace_sched_decision(packet, cpu_dest, tight);
+	account_redirect(cpu_dest, packet_service_time(packet));
+	return ret;
+}
+
+/**
+ * upper bound (exclusive) on the service time (`data`) of the requests of each
+ * tier, in increasing order. A request belongs to the first tier whose bound
+ * exceeds its service time, and the last tier takes all remaining requests.
+ * Thus only the first `tier_count - 1` entries are used.
+ */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, MAX_TIERS);
+} tier_bounds SEC(".maps");
+
+/* 0: number of tiers in use */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, 1);
+} tier_count SEC(".maps");
+
+/* cpus of every tier. The i'th cpu of tier t is at key t * MAX_SCHED_CPUS + i */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, MAX_TIERS * MAX_SCHED_CPUS);
+} tier_cpus SEC(".maps");
+
+/* number of cpus dedicated to every tier */
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, MAX_TIERS);
+} tier_cpu_count SEC(".maps");
+
+/* round-robin iterator of every tier, seeded like `cpu_iter` */
+struct {
+	__uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+	__type(key, __u32);
+	__type(value, __u32);
+	__uint(max_entries, MAX_TIERS);
+} tier_iter SEC(".maps");
+
+/**
+ * @return the tier of a packet whose requests add up to service time `work`
+ * according to `tier_bounds`, or -1 on failure
+ */
+static __always_inline int classify_tier(__u32 work)
+{
+	__u32 *num_tiers;
+	__u32 key0 = 0;
+	int tier = 0;
+
+	num_tiers = bpf_map_lookup_elem(&tier_count, &key0);
+	if (!num_tiers)
+		return -1;
+
+	for (__u32 t = 0; t < MAX_TIERS - 1; t++) {
+		__u32 key = t;
+		if (key + 1 >= *num_tiers)
+			break;
+
+		__u32 *bound = bpf_map_lookup_elem(&tier_bounds, &key);
+		if (!bound)
+			return -1;
+		if (work < *bound)
+			break;
+		tier = t + 1;
+	}
+
+	return tier;
+}
+
+/**
+ * Generalization of round-robin with core-separation to up to `MAX_TIERS`
+ * service-time tiers, each with its own set of cpus in which requests are
+ * redirected in round-robin fashion.
+ */
+SEC("xdp")
+int bpf_redirect_tiered(struct xdp_md *ctx)
+{
+	__u32 *cpu_count, *cpu_iterator, *cpu;
+	struct packet *packet;
+	__u32 cpu_idx, key;
+	int tier;
+
+	count_rx_packet();
+
+	void *data = (void *)(long)ctx->data;
+	void *data_end = (void *)(long)ctx->data_end;
+	struct hdr_cursor nh = { .pos = data };
+
+	if (!bpfnic_benchmark_parse_and_timestamp_packet(ctx, &nh))
+		return XDP_PASS;
+
+	packet = nh.pos;
+	if (packet + 1 > data_end)
+		return XDP_DROP;
+
+	tier = classify_tier(packet->work);
+	if (tier < 0 || tier >= MAX_TIERS)
+		return XDP_DROP;
+	key = tier;
+
+	cpu_count = bpf_map_lookup_elem(&tier_cpu_count, &key);
+	if (!cpu_count)
+		return XDP_DROP;
+	cpu_iterator = bpf_map_lookup_elem(&tier_iter, &key);
+	if (!cpu_iterator)
+		return XDP_DROP;
+
+	cpu_idx = round_robin_next(cpu_iterator, *cpu_count);
+
+	key = key * MAX_SCHED_CPUS + cpu_idx;
+	cpu = bpf_map_lookup_elem(&tier_cpus, &key);
+	if (!cpu)
+		return XDP_DROP;
+
+	if (!admit_request(*cpu))
+		return shed_request(ctx);
+
+	long ret = bpf_redirect_map(&cpu_map, *cpu, 0);
+	if (ret != XDP_REDIRECT) {
+		bpf_printk("bpf_redirect_map (cpumap) failure: ret code = %d",
+			   ret);
+		return XDP_DROP;
+	}
+	trace_sched_decision(packet, *cpu, tier);
+	account_redirect(*cpu, packet_service_time(packet));
+	return ret;
+}
+
+/**
+ * Accounts the requests that the cpumap queue of `to_cpu` dropped for being
+ * full as no longer outstanding. Fires upon every bulk enqueue by an rx cpu.
+ */
+SEC("tracepoint/xdp/xdp_cpumap_enqueue")
+int bpfnic_cpumap_enqueue(struct trace_event_raw_xdp_cpumap_enqueue *ctx)
+{
+	__u32 cpu = ctx->to_cpu;
+	__u64 drops = ctx->drops;
+
+	if (drops == 0)
+		return 0;
+
+	__u64 *inflight = bpf_map_lookup_elem(&cpu_inflight, &cpu);
+	__u64 *work = bpf_map_lookup_elem(&cpu_outstanding_work, &cpu);
+	if (inflight) {
+		__u64 queued = *inflight;
+		if (work && queued > 0)
+			atomic_sub_clamped(work, drops * (*work / queued));
+
+		// the rounding of the average must not leave phantom work behind
+		if (atomic_sub_clamped(inflight, drops) == 0 && work)
+			atomic_sub_clamped(work, *work);
+	}
+
+	// shares the slot with the cpumap program of `cpu`, hence the atomic
+	struct cpu_counters *stats = bpf_map_lookup_elem(&cpu_stats, &cpu);
+	if (stats)
+		__sync_fetch_and_add(&stats->enqueue_drops, drops);
+	return 0;
+}
+
 SEC("tc")
 int bpfnic_tc(struct __sk_buff *ctx)
 {
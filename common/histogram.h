@@ -0,0 +1,89 @@
+#ifndef HISTOGRAM
+#define HISTOGRAM
+
+/**
+ * @brief log-linear bucketing shared by the in-kernel latency histograms and
+ * the user space that reads them.
+ *
+ * Values below `HIST_SUB_BUCKETS` get a bucket each. Above that, every power
+ * of two is split into `HIST_SUB_BUCKETS` linear sub-buckets, bounding the
+ * relative error of a bucket to 1 / HIST_SUB_BUCKETS. Values are in ns.
+ */
+
+#define HIST_SUB_BUCKET_BITS 3
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BUCKET_BITS)
+// values of 2^(HIST_MAX_LOG2 + 1) ns (~17 minutes) or more land in the last bucket
+#define HIST_MAX_LOG2 39
+#define HIST_NUM_BUCKETS ((HIST_MAX_LOG2 - HIST_SUB_BUCKET_BITS + 2) * HIST_SUB_BUCKETS)
+
+struct latency_hist {
+	unsigned long long buckets[HIST_NUM_BUCKETS];
+};
+
+/// @return floor(log2(value)), without loops such that the verifier is happy
+static inline unsigned int hist_log2(unsigned long long value)
+{
+	unsigned int r = 0;
+
+	if (value >> 32) {
+		value >>= 32;
+		r += 32;
+	}
+	if (value >> 16) {
+		value >>= 16;
+		r += 16;
+	}
+	if (value >> 8) {
+		value >>= 8;
+		r += 8;
+	}
+	if (value >> 4) {
+		value >>= 4;
+		r += 4;
+	}
+	if (value >> 2) {
+		value >>= 2;
+		r += 2;
+	}
+	if (value >> 1)
+		r += 1;
+	return r;
+}
+
+/// @return the index of the bucket `value` falls in
+static inline unsigned int hist_bucket(unsigned long long value)
+{
+	if (value < HIST_SUB_BUCKETS)
+		return (unsigned int)value;
+
+	unsigned int msb = hist_log2(value);
+	if (msb > HIST_MAX_LOG2)
+		return HIST_NUM_BUCKETS - 1;
+
+	unsigned int shift = msb - HIST_SUB_BUCKET_BITS;
+	unsigned int sub = (value >> shift) & (HIST_SUB_BUCKETS - 1);
+	return (msb - HIST_SUB_BUCKET_BITS + 1) * HIST_SUB_BUCKETS + sub;
+}
+
+/// @return the smallest value that falls in bucket `index`
+static inline unsigned long long hist_bucket_lower(unsigned int index)
+{
+	if (index < HIST_SUB_BUCKETS)
+		return index;
+
+	unsigned int msb = index / HIST_SUB_BUCKETS - 1 + HIST_SUB_BUCKET_BITS;
+	unsigned long long sub = index % HIST_SUB_BUCKETS;
+	return (1ULL << msb) + (sub << (msb - HIST_SUB_BUCKET_BITS));
+}
+
+/// @return the number of distinct values that fall in bucket `index`
+static inline unsigned long long hist_bucket_width(unsigned int index)
+{
+	if (index < HIST_SUB_BUCKETS)
+		return 1;
+
+	unsigned int msb = index / HIST_SUB_BUCKETS - 1 + HIST_SUB_BUCKET_BITS;
+	return 1ULL << (msb - HIST_SUB_BUCKET_BITS);
+}
+
+#endif
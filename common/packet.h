@@ -1,20 +1,58 @@
 #ifndef PACKET
 #define PACKET
 
+// version of the wire format, bumped upon incompatible changes
+#define PACKET_VERSION 3
+
+// upper bound on the requests batched into a datagram, for loops the verifier
+// must bound
+#define PACKET_MAX_REQUESTS 16
+
 /**
- * @brief packet that is sent to server. 3 timestamps and some data. No need for
- * time when client is reached as this is handled implicitly.
+ * @brief header of a datagram sent to the server, followed by `num_requests`
+ * `struct packet_request`. 3 timestamps shared by all requests of the
+ * datagram. No need for time when client is reached as this is handled
+ * implicitly.
  *
  * the naming of the `leave_server_timestamp` means to represent the time after
  * the queuing delay, but BEFORE the synthetic workload has been run on the
  * target CPU of a packet.
+ *
+ * The requests of a datagram are scheduled as a unit, using the `work` and
+ * `deadline_us` summaries the server fills in upon reception.
  */
 struct __attribute__((packed)) packet {
+	unsigned char version; // PACKET_VERSION
+	unsigned char num_requests; // 1 to PACKET_MAX_REQUESTS
+	unsigned char flags; // PACKET_FLAG_*, set by the server
+	unsigned char pad;
+	unsigned int work; // total service time of the requests, set by the server
+	unsigned int deadline_us; // tightest deadline of the requests, set by the
+		// server. 0 if all are best-effort
 	unsigned long leave_client_timestamp;
 	unsigned long reach_server_timestamp;
 	unsigned long leave_server_timestamp;
-	unsigned char data; // in the eBPF looping logic, this will be interpreted
-		// loop time = data * 10 [us]
 };
 
+/**
+ * @brief a request batched into a datagram, following its `struct packet`
+ */
+struct __attribute__((packed)) packet_request {
+	unsigned int id; // chosen by the client, echoed back by the server
+	unsigned short service_time; // in the eBPF looping logic, this will be
+		// interpreted loop time = service_time * 10 [us]
+	unsigned char flags; // PACKET_FLAG_*, set by the server
+	unsigned char pad;
+	unsigned int deadline_us; // SLO of the request relative to when it left
+		// the client. 0 if best-effort
+	unsigned long intended_send_timestamp; // when the client's schedule
+		// meant to send the request, on the client's clock
+};
+
+// size of a datagram carrying `n` requests
+#define PACKET_SIZE(n) (sizeof(struct packet) + (n) * sizeof(struct packet_request))
+
+// the server shed the request without processing it, see `struct admission_config`
+#define PACKET_FLAG_OVERLOADED 0x1
+
 #endif
@@ -0,0 +1,53 @@
+#ifndef SCHED
+#define SCHED
+
+/**
+ * @brief limits shared by the XDP scheduling programs and the user space
+ * loader.
+ */
+
+// upper bound on the size of a core group, for loops the verifier must bound
+#define MAX_SCHED_CPUS 64
+
+// maximum number of service-time tiers of the tiered policy. Tier `t` owns the
+// keys `[t * MAX_SCHED_CPUS, (t + 1) * MAX_SCHED_CPUS)` of the `tier_cpus` map
+#define MAX_TIERS 8
+
+/**
+ * @brief work stealing between the cpumap programs of the `cpus_available`
+ * group: a cpu with at least `queue_threshold` outstanding requests hands a
+ * request over to an idle cpu, at most `max_hops` times per request.
+ * `queue_threshold` = 0 disables stealing.
+ */
+struct steal_config {
+	unsigned int queue_threshold;
+	unsigned int max_hops;
+};
+
+/**
+ * @brief admission control of the XDP scheduling programs: a request whose
+ * predicted queuing delay, the outstanding work of its destination cpu, exceeds
+ * `deadline_us` is shed. It is dropped, or sent back right away with the
+ * PACKET_FLAG_OVERLOADED flag if `reply` is set. `deadline_us` = 0 admits all.
+ */
+struct admission_config {
+	unsigned long long deadline_us;
+	unsigned int reply;
+	unsigned int pad;
+};
+
+/**
+ * @brief sampled scheduling decision, emitted by the XDP scheduling programs
+ * into the `sched_events` ring buffer. Written as-is to the trace file.
+ */
+struct sched_event {
+	unsigned long long arrival_ts; // reach_server_timestamp of the request
+	unsigned int cpu; // destination cpu
+	unsigned int queue_depth; // outstanding requests at `cpu` upon redirect
+	unsigned int rx_cpu; // cpu that took the scheduling decision
+	unsigned char class_id; // tier, 0/1 for short/long, hashed/spilled or loose/tight
+	unsigned char pad;
+	unsigned short work; // service time of the requests, see `struct packet`
+};
+
+#endif
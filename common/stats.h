@@ -0,0 +1,30 @@
+#ifndef STATS
+#define STATS
+
+/**
+ * @brief monotonic counters of the requests processed by a cpu. The cpumap
+ * program of every cpu only writes its own slot of the `cpu_stats` map, which
+ * user space reads through mmap and turns into per-window deltas. Slots span a
+ * cache line each, such that cpus never write to a shared line.
+ */
+struct cpu_counters {
+	unsigned long long tx_packets; // requests processed
+	unsigned long long srv_time; // total queuing delay, in ns
+	unsigned long long work; // total service time, in us
+	unsigned long long busy_time; // total time spent processing, in ns
+	unsigned long long stolen; // requests handed over to an idle cpu
+	unsigned long long enqueue_drops; // requests dropped by the full cpumap queue
+	unsigned long long pad[2];
+} __attribute__((aligned(64)));
+
+/**
+ * @brief monotonic counts of the packets received by a cpu, in the `rx_packet_ctr`
+ * map. Padded to a cache line for the same reason as `struct cpu_counters`.
+ */
+struct rx_counter {
+	unsigned long long packets;
+	unsigned long long shed; // requests refused by admission control
+	unsigned long long pad[6];
+} __attribute__((aligned(64)));
+
+#endif
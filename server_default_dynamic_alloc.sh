@@ -1,3 +1,3 @@
 #!/bin/bash
 
-./bpfnic -m server -p 50000 -d 60 -i lo -P dca -c 8 
+./bpfnic -m server -p 50000 -d 60 -i lo -P dca -c 8 --p99_target_us 500
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+./bpfnic -m server -p 50000 -d 60 -i lo -P dcau -c 8 
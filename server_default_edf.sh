@@ -0,0 +1,3 @@
+#!/bin/bash
+
+./bpfnic -m server -p 50000 -d 60 -i lo -P edf -c 8 --latency_cpus 2 --tight_deadline_us 100
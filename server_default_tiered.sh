@@ -0,0 +1,3 @@
+#!/bin/bash
+
+./bpfnic -m server -p 50000 -d 60 -i lo -P tiered -c 8 -B 5,50 -T 4,2,2 
@@ -4,12 +4,23 @@
 /**
  * A benchmark wraps a vector of clients
  */
+#include <fstream>
 #include <memory>
 #include <vector>
 
 #include "Client.hpp"
 #include "ThreadPool.cpp"
 
+/// requests sent and received by all clients over a window, their delivery anomalies and send drift
+struct WindowDelivery {
+  uint64_t throughput;
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  uint64_t rejected = 0;
+  DeliveryCounts anomalies;
+  DriftStats sendDrift;
+};
+
 /**
  * A Benchmark manages the lifecycle of a vector of Clients, and manages their
  * execution.
@@ -64,8 +75,8 @@ class Benchmark {
 
     for (unsigned i = 0; i < numClients; i++) {
       std::vector<double> probabilities = {0.9, 0.1};
-      std::vector<unsigned char> serviceTimes = {DEFAULT_SERVICE_TIME, 10 * DEFAULT_SERVICE_TIME};
-      auto generator = DiscreteValueGenerator<unsigned char>::create(probabilities, serviceTimes);
+      std::vector<unsigned short> serviceTimes = {DEFAULT_SERVICE_TIME, 10 * DEFAULT_SERVICE_TIME};
+      auto generator = DiscreteValueGenerator<unsigned short>::create(probabilities, serviceTimes);
 
       auto clientRet = Client::create(destIP, port, std::move(generator));
       if (clientRet.second != Err::NoError) return {nullptr, clientRet.second};
@@ -90,12 +101,41 @@ class Benchmark {
     startClients();
     for (unsigned i = 0; i < windowDurations.size(); i++) {
       executeWindow(windowDurations[i], windowThroughputs[i]);
-      std::cout << "sent: " << packetsOut << ", recv: " << packetsIn << std::endl;
+      std::cout << "sent: " << packetsOut << ", recv: " << packetsIn << ", rejected: " << packetsRejected << std::endl;
+      const DeliveryCounts& anomalies = deliveryPerWindow.back().anomalies;
+      std::cout << "window lost: " << anomalies.lost << ", reordered: " << anomalies.reordered
+                << ", duplicates: " << anomalies.duplicates << ", late: " << anomalies.late << std::endl;
+      const DriftStats& drift = deliveryPerWindow.back().sendDrift;
+      std::cout << "send drift avg: " << drift.avgNanos() << " ns, max: " << drift.maxNanos << " ns" << std::endl;
     }
     stopClients();
+    if (!deliveryPerWindow.empty())
+      std::cout << "last window lost after drain: " << deliveryPerWindow.back().anomalies.lost << std::endl;
     writeResults("output");
   }
 
+  /**
+   * Makes all clients schedule their requests following `process`, replaying
+   * `replayGapsNanos` with Pacer::Process::Replay
+   */
+  void setArrivalProcess(Pacer::Process process, const std::vector<uint64_t>& replayGapsNanos = {}) {
+    for (auto& client : clients) client->setPacer(std::make_unique<Pacer>(process, replayGapsNanos));
+  }
+
+  /// makes all clients batch `batchSize` requests per datagram
+  void setBatchSize(unsigned batchSize) {
+    for (auto& client : clients) client->setBatchSize(batchSize);
+  }
+
+  /**
+   * Sets the deadline of the requests of all clients to `deadlinesUs[i]` with
+   * probability `probabilities[i]`. A deadline of 0 makes a request best-effort
+   */
+  void setDeadlineMix(std::vector<double> probabilities, std::vector<unsigned int> deadlinesUs) {
+    for (auto& client : clients)
+      client->setDeadlineDistribution(DiscreteValueGenerator<unsigned int>::create(probabilities, deadlinesUs));
+  }
+
  private:
   std::vector<std::unique_ptr<Client>> clients;
   ThreadPool threadPool;
@@ -104,37 +144,99 @@ class Benchmark {
 
   uint64_t packetsOut = 0;
   uint64_t packetsIn = 0;
+  uint64_t packetsRejected = 0;  // shed by the server's admission control, included in packetsIn
+  std::vector<WindowDelivery> deliveryPerWindow;
 
-  std::pair<LatencyHistogramVec, LatencyHistogramVec> mergeClientHistograms() {
-    LatencyHistogramVec rtt = clients[0]->getRoundtripHistogram();
-    LatencyHistogramVec qd = clients[0]->getQueuingDelayHistogram();
+  /// histograms of all clients, see `Client`
+  struct ClientHistograms {
+    LatencyHistogramVec rtt;
+    LatencyHistogramVec rttCorrected;
+    LatencyHistogramVec qd;
+  };
+
+  ClientHistograms mergeClientHistograms() {
+    ClientHistograms merged = {
+        .rtt = clients[0]->getRoundtripHistogram(),
+        .rttCorrected = clients[0]->getCorrectedRoundtripHistogram(),
+        .qd = clients[0]->getQueuingDelayHistogram(),
+    };
 
     for (unsigned i = 1; i < clients.size(); i++) {
-      rtt.mergeWith(clients[i]->getRoundtripHistogram());
-      qd.mergeWith(clients[i]->getQueuingDelayHistogram());
+      merged.rtt.mergeWith(clients[i]->getRoundtripHistogram());
+      merged.rttCorrected.mergeWith(clients[i]->getCorrectedRoundtripHistogram());
+      merged.qd.mergeWith(clients[i]->getQueuingDelayHistogram());
     }
 
-    return {rtt, qd};
+    return merged;
+  }
+
+  /// prints the corrected round-trip percentiles of all clients since the last call, in microseconds
+  void printIntervalPercentiles() {
+    LogLinearHistogram interval;
+    for (auto& client : clients) interval.mergeWith(client->getIntervalRoundtripHistogram());
+    if (interval.getTotalCount() == 0) return;
+
+    std::cout << "rtt p50: " << interval.valueAtPercentile(50) / 1000.0
+              << " us, p99: " << interval.valueAtPercentile(99) / 1000.0
+              << " us, p999: " << interval.valueAtPercentile(99.9) / 1000.0 << " us" << std::endl;
+  }
+
+  /// adds the requests sent and received by all clients since the last call to the current window
+  void collectDelivery() {
+    WindowDelivery& delivery = deliveryPerWindow.back();
+    for (auto& client : clients) {
+      size_t sent = client->getSentPackets();
+      size_t received = client->getReceivedPackets();
+      size_t rejected = client->getRejectedPackets();
+
+      delivery.sent += sent;
+      delivery.received += received;
+      delivery.rejected += rejected;
+      delivery.anomalies += client->getDeliveryCounts();
+      delivery.sendDrift += client->getSendDrift();
+      packetsOut += sent;
+      packetsIn += received;
+      packetsRejected += rejected;
+    }
   }
 
   void executeWindow(int duration, uint64_t throughput) {
+    deliveryPerWindow.push_back({.throughput = throughput});
     while (duration > 0) {
       updateClientThroughputs(throughput);
-      for (auto& client : clients) {
-        packetsOut += client->getSentPackets();
-        packetsIn += client->getReceivedPackets();
-      }
+      collectDelivery();
+      printIntervalPercentiles();
       duration--;
       sleep(1);
     }
   }
 
+  // writes the per-window delivery of requests as a .csv. Returns -1 on failure
+  int writeDeliveryCSV(std::string filename) {
+    std::ofstream file(filename);
+
+    if (!file.is_open()) {
+      return -1;
+    }
+
+    file << "throughput,sent,received,rejected,lost,reordered,duplicates,late,drift_avg_nanos,drift_max_nanos\n";
+    for (auto& delivery : deliveryPerWindow) {
+      file << delivery.throughput << "," << delivery.sent << "," << delivery.received << "," << delivery.rejected
+           << "," << delivery.anomalies.lost << "," << delivery.anomalies.reordered << ","
+           << delivery.anomalies.duplicates << "," << delivery.anomalies.late << "," << delivery.sendDrift.avgNanos()
+           << "," << delivery.sendDrift.maxNanos << "\n";
+    }
+
+    file.close();
+    return 0;
+  }
+
   void updateClientThroughputs(uint64_t newThroughput) {
-    uint64_t rpsPerClient = newThroughput / clients.size();
+    double rpsPerClient = (double)newThroughput / clients.size();
     std::cout << "current Rps = " << newThroughput << "\n";
     for (auto& client : clients) {
       client->setThroughput(newThroughput);
-      client->incrementTokens(rpsPerClient);
+      client->setRate(rpsPerClient);
     }
   }
 
@@ -147,17 +249,25 @@ class Benchmark {
     }
   }
 
-  /// stops all clients managed by the benchmark
+  /**
+   * stops all clients managed by the benchmark, and waits for them to drain
+   * the replies in flight. These, and the requests that are still missing, are
+   * counted in the last window
+   */
   void stopClients() {
     for (auto& client : clients) {
       client->stop();
     }
+    for (auto& client : clients) client->waitUntilStopped();
+    if (!deliveryPerWindow.empty()) collectDelivery();
   }
 
   void writeResults(std::string prefix) {
     auto histograms = mergeClientHistograms();
-    histograms.first.writeToCSV(prefix + "_rtt.csv");
-    histograms.second.writeToCSV(prefix + "_qd.csv");
+    histograms.rtt.writeToCSV(prefix + "_rtt.csv");
+    histograms.rttCorrected.writeToCSV(prefix + "_rtt_corrected.csv");
+    histograms.qd.writeToCSV(prefix + "_qd.csv");
+    writeDeliveryCSV(prefix + "_delivery.csv");
   }
 };
 
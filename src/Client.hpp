@@ -2,20 +2,29 @@
 #define _CLIENT_H
 
 #include <DiscreteValueGenerator.hpp>
+#include <IntervalRecorder.hpp>
 #include <LatencyHistogramVec.hpp>
+#include <Pacer.hpp>
+#include <SequenceTracker.hpp>
 #include <UDPSocket.hpp>
+#include <algorithm>
+#include <array>
 #include <atomic>
-#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <thread>
 
 #define DEFAULT_SERVICE_TIME 1  // 1us
+#define DEFAULT_DEADLINE 0      // best-effort
 
 /**
  * Defines a Client, which manages the generation of variable throughput
  * traffic via a UDP socket, and maintains a histogram of queuing delays and
- * round-trip times
+ * round-trip times. The ids of received requests are tracked to detect loss,
+ * reordering and duplicates. Corrected round-trip times are also recorded into
+ * an IntervalRecorder, which another thread can take while the client runs
  *
- * The token bucket algorithm is used for rate limiting
+ * Requests are sent open-loop, following the arrival schedule of a Pacer
  */
 class Client {
  public:
@@ -25,18 +34,28 @@ class Client {
         stopFlag(false),
         numSentPackets(0),
         numReceivedPackets(0),
-        tokenBucket(std::make_unique<std::atomic<uint64_t>>(0)),
-        serviceTimeGenerator(DiscreteValueGenerator<unsigned char>::create(
-            std::vector<double>{1.0}, std::vector<unsigned char>{DEFAULT_SERVICE_TIME})) {}
+        numRejectedPackets(0),
+        batchSize(1),
+        nextRequestId(0),
+        pacer(std::make_unique<Pacer>(Pacer::Process::Poisson)),
+        serviceTimeGenerator(DiscreteValueGenerator<unsigned short>::create(
+            std::vector<double>{1.0}, std::vector<unsigned short>{DEFAULT_SERVICE_TIME})),
+        deadlineGenerator(DiscreteValueGenerator<unsigned int>::create(std::vector<double>{1.0},
+                                                                       std::vector<unsigned int>{DEFAULT_DEADLINE})) {}
 
   /// @brief constructor with explicit service time distribution
-  Client(std::unique_ptr<UDPSocket> sock, std::unique_ptr<DiscreteValueGenerator<unsigned char>> serviceTimeGenerator)
+  Client(std::unique_ptr<UDPSocket> sock, std::unique_ptr<DiscreteValueGenerator<unsigned short>> serviceTimeGenerator)
       : udpSocket(std::move(sock)),
         stopFlag(false),
         numSentPackets(0),
         numReceivedPackets(0),
-        tokenBucket(std::make_unique<std::atomic<uint64_t>>(0)),
-        serviceTimeGenerator(std::move(serviceTimeGenerator)) {}
+        numRejectedPackets(0),
+        batchSize(1),
+        nextRequestId(0),
+        pacer(std::make_unique<Pacer>(Pacer::Process::Poisson)),
+        serviceTimeGenerator(std::move(serviceTimeGenerator)),
+        deadlineGenerator(DiscreteValueGenerator<unsigned int>::create(std::vector<double>{1.0},
+                                                                       std::vector<unsigned int>{DEFAULT_DEADLINE})) {}
 
   /**
    * @return unique_ptr to a Client with default service time generator on
@@ -54,7 +73,8 @@ class Client {
    * on success, or a SocketError on failure
    */
   static std::pair<std::unique_ptr<Client>, Err::SocketError> create(
-      const std::string destIP, int port, std::unique_ptr<DiscreteValueGenerator<unsigned char>> serviceTimeGenerator) {
+      const std::string destIP, int port,
+      std::unique_ptr<DiscreteValueGenerator<unsigned short>> serviceTimeGenerator) {
     auto socketRet = UDPSocket::create(destIP, port);
     if (socketRet.second != Err::NoError) return {nullptr, socketRet.second};
 
@@ -63,111 +83,230 @@ class Client {
 
   /// @brief set the distribution. Allows for runtime reques distribution
   /// changes
-  void setServiceTimeDistribution(std::unique_ptr<DiscreteValueGenerator<unsigned char>> newDistribution) {
+  void setServiceTimeDistribution(std::unique_ptr<DiscreteValueGenerator<unsigned short>> newDistribution) {
     serviceTimeGenerator = std::move(newDistribution);
   }
 
-  void start() { stopFlag = false; }
+  /// @brief batch `newBatchSize` requests, at most PACKET_MAX_REQUESTS, into a
+  /// datagram sent when the last of them is due
+  void setBatchSize(unsigned newBatchSize) { batchSize = newBatchSize; }
+
+  /// @brief replaces the arrival schedule, e.g. to change the arrival process.
+  /// Must not be called while the client is running
+  void setPacer(std::unique_ptr<Pacer> newPacer) { pacer = std::move(newPacer); }
+
+  /// @brief set the distribution of request deadlines in us, 0 being best-effort
+  void setDeadlineDistribution(std::unique_ptr<DiscreteValueGenerator<unsigned int>> newDistribution) {
+    deadlineGenerator = std::move(newDistribution);
+  }
+
+  void start() {
+    stopFlag = false;
+    recvStopped = false;
+  }
   void stop() { stopFlag = true; }
 
+  /// blocks until the receive loop has drained the replies in flight at `stop`
+  void waitUntilStopped() {
+    while (!recvStopped) std::this_thread::sleep_for(std::chrono::milliseconds(RECV_TIMEOUT_MS));
+  }
+
+  /**
+   * receives replies until no reply arrived for RECV_TIMEOUT_MS after `stop`,
+   * then counts the requests still missing as lost
+   */
   void recvLoop() {
-    while (!stopFlag) {
-      numReceivedPackets++;
-      if (recvAndProcessPacket() != Err::NoError) std::cerr << "Invalid packet format...\n";
+    while (true) {
+      auto recvRet = udpSocket->recvPackets();
+      if (recvRet.second == Err::RecvTimeout) {
+        if (stopFlag) break;
+        continue;
+      }
+      if (recvRet.second != Err::NoError) {
+        std::cerr << "Invalid packet format...\n";
+        continue;
+      }
+
+      for (size_t i = 0; i < recvRet.first; i++) {
+        auto packet = udpSocket->getRecvPacket(i);
+        if (processPacket(packet.first, packet.second) != Err::NoError) std::cerr << "Invalid packet format...\n";
+      }
     }
+
+    sequenceTracker.flush();
+    recvStopped = true;
   }
 
   void sendLoop() {
+    std::vector<char> buffer(MAX_IO_BATCH * PACKET_SIZE(PACKET_MAX_REQUESTS));
+    std::array<struct packet *, MAX_IO_BATCH> packets;
+    for (unsigned i = 0; i < MAX_IO_BATCH; i++)
+      packets[i] = (struct packet *)(buffer.data() + i * PACKET_SIZE(PACKET_MAX_REQUESTS));
+
+    std::array<uint64_t, MAX_IO_BATCH> scheduledTimes;
+    std::array<uint64_t, PACKET_MAX_REQUESTS> arrivals;
+
+    uint64_t scheduled = 0;  // of the next datagram, 0 if not scheduled yet
     while (!stopFlag) {
-      if (tokenBucket->load() <= 0) continue;
-      tokenBucket->fetch_sub(1);
+      if (!scheduled && !(scheduled = scheduleDatagram(arrivals.data()))) {
+        // paused until a rate is set
+        pacer->waitUntil(Pacer::now() + PACER_MAX_SLEEP_NANOS, stopFlag);
+        continue;
+      }
+      if (!pacer->waitUntil(scheduled, stopFlag)) break;
 
-      if (genAndSendPacket() == Err::NoError)
-        numSentPackets++;
-      else
+      // datagrams already due as the sender fell behind leave with the same syscall
+      unsigned numPackets = 0;
+      do {
+        scheduledTimes[numPackets] = scheduled;
+        genPacket(packets[numPackets++], batchSize, arrivals.data());
+        scheduled = scheduleDatagram(arrivals.data());
+      } while (numPackets < MAX_IO_BATCH && scheduled && scheduled <= Pacer::now());
+
+      auto sendRet = udpSocket->sendPackets(std::span(packets.data(), numPackets));
+      uint64_t sentAt = Pacer::now();
+      for (size_t i = 0; i < sendRet.first; i++) {
+        numSentPackets += packets[i]->num_requests;
+        pacer->recordSend(scheduledTimes[i], sentAt);
+      }
+      if (sendRet.second != Err::NoError)
         // TODO add more robust handling here instead of just printing
         std::cout << "error sending packet" << std::endl;
     }
   }
 
-  /// @return the number of send packets
-  size_t getSentPackets() {
-    size_t ret = numSentPackets;
-    numSentPackets = 0;
-    return ret;
-  }
+  /// @return the number of sent requests
+  size_t getSentPackets() { return numSentPackets.exchange(0); }
 
-  /// @return the number of received packets
-  size_t getReceivedPackets() {
-    size_t ret = numReceivedPackets;
-    numReceivedPackets = 0;
-    return ret;
-  }
+  /// @return the number of received requests
+  size_t getReceivedPackets() { return numReceivedPackets.exchange(0); }
+
+  /// @return the number of received requests that the server shed as overloaded
+  size_t getRejectedPackets() { return numRejectedPackets.exchange(0); }
+
+  /// @return how far sends drifted from their schedule since the last call
+  DriftStats getSendDrift() { return pacer->takeDrift(); }
+
+  /// @return the delivery anomalies detected since the last call
+  DeliveryCounts getDeliveryCounts() { return sequenceTracker.takeCounts(); }
 
   LatencyHistogramVec getRoundtripHistogram() { return roundTripHistogram; }
 
+  LatencyHistogramVec getCorrectedRoundtripHistogram() { return correctedRoundTripHistogram; }
+
   LatencyHistogramVec getQueuingDelayHistogram() { return queuingDelayHistogram; }
 
-  void incrementTokens(uint64_t by) { tokenBucket->fetch_add(by); }
+  /// @return the corrected round-trip times of all labels since the last call.
+  /// Safe to call while the client is running
+  LogLinearHistogram getIntervalRoundtripHistogram() { return intervalRoundTrips.takeInterval(); }
+
+  /// sets the mean rate at which this client sends requests. 0 pauses it
+  void setRate(double rps) { pacer->setRate(rps); }
   void setThroughput(uint64_t newThroughput) { throughputRps = newThroughput; }
 
  private:
   std::unique_ptr<UDPSocket> udpSocket;
   volatile bool stopFlag;
-  size_t numSentPackets;
-  size_t numReceivedPackets;
+  std::atomic<bool> recvStopped = false;
+  // taken by the benchmark thread while the client runs
+  std::atomic<size_t> numSentPackets;
+  std::atomic<size_t> numReceivedPackets;
+  std::atomic<size_t> numRejectedPackets;
+  unsigned batchSize;
+  uint32_t nextRequestId;
 
   LatencyHistogramVec roundTripHistogram;
+  // round-trip times from the intended send time, that hide no delay of a sender falling behind schedule
+  LatencyHistogramVec correctedRoundTripHistogram;
   LatencyHistogramVec queuingDelayHistogram;
+  IntervalRecorder intervalRoundTrips;
+  SequenceTracker sequenceTracker;
 
-  // finite bucket of tokens used for rate limiting
-  std::unique_ptr<std::atomic<uint64_t>> tokenBucket;
+  // schedules when requests are sent
+  std::unique_ptr<Pacer> pacer;
   // generates service times
-  std::unique_ptr<DiscreteValueGenerator<unsigned char>> serviceTimeGenerator;
+  std::unique_ptr<DiscreteValueGenerator<unsigned short>> serviceTimeGenerator;
+  // generates request deadlines
+  std::unique_ptr<DiscreteValueGenerator<unsigned int>> deadlineGenerator;
 
   uint64_t throughputRps;
 
-  /// @return a high-resolution timestamp in nanoseconds
-  uint64_t getTimeStamp() {
-    auto currTime = std::chrono::high_resolution_clock::now();
-    auto nanos = std::chrono::time_point_cast<std::chrono::nanoseconds>(currTime).time_since_epoch();
-    return std::chrono::duration_cast<std::chrono::nanoseconds>(nanos).count();
-  }
+  /// @return a high-resolution timestamp in nanoseconds, on the clock of the pacer's schedule
+  uint64_t getTimeStamp() { return Pacer::now(); }
 
-  Err::SocketError recvAndProcessPacket() {
-    auto recvRet = udpSocket->recvPacket();
-    if (recvRet.second != Err::NoError) return recvRet.second;
-    int bytesReceived = recvRet.first;
-    if (bytesReceived != sizeof(struct packet)) return Err::InvalidPacket;
+  /// records the requests of the `bytesReceived`-long datagram at `buffer`
+  Err::SocketError processPacket(char *buffer, size_t bytesReceived) {
+    if (bytesReceived < sizeof(struct packet)) return Err::InvalidPacket;
 
     /// interpret the element in the receive buffer as a packet
-    struct packet *p = (struct packet *)udpSocket->getRecvBuffer();
+    struct packet *p = (struct packet *)buffer;
+    if (p->version != PACKET_VERSION || p->num_requests == 0 || p->num_requests > PACKET_MAX_REQUESTS ||
+        bytesReceived != PACKET_SIZE(p->num_requests))
+      return Err::InvalidPacket;
+
+    numReceivedPackets += p->num_requests;
+
+    uint64_t receivedAt = getTimeStamp();
+    struct packet_request *requests = (struct packet_request *)(p + 1);
+    for (unsigned i = 0; i < p->num_requests; i++)
+      sequenceTracker.record(requests[i].id, requests[i].intended_send_timestamp, receivedAt);
+
+    // shed requests were not served, their latency is not that of the server
+    if (p->flags & PACKET_FLAG_OVERLOADED) {
+      numRejectedPackets += p->num_requests;
+      return Err::NoError;
+    }
 
-    uint64_t roundtripNanos = getTimeStamp() - p->leave_client_timestamp;
+    // all requests of a datagram share its timestamps, but not their intended send time
+    uint64_t roundtripNanos = receivedAt - p->leave_client_timestamp;
     uint64_t queuingDelayNanos = p->leave_server_timestamp - p->reach_server_timestamp;
 
-    LabelValues l = {
-        .throughput = throughputRps,
-        .serviceTime = p->data,
-    };
+    for (unsigned i = 0; i < p->num_requests; i++) {
+      LabelValues l = {
+          .throughput = throughputRps,
+          .serviceTime = requests[i].service_time,
+      };
 
-    roundTripHistogram.increment(l, roundtripNanos);
-    queuingDelayHistogram.increment(l, queuingDelayNanos);
+      roundTripHistogram.increment(l, roundtripNanos);
+      uint64_t correctedNanos = receivedAt - requests[i].intended_send_timestamp;
+      correctedRoundTripHistogram.increment(l, correctedNanos);
+      intervalRoundTrips.record(correctedNanos);
+      queuingDelayHistogram.increment(l, queuingDelayNanos);
+    }
 
     return Err::NoError;
   }
 
   /**
-   * @brief generates and sends a packet over the UDP socket
+   * @brief schedules the next `batchSize` arrivals of the pacer into `arrivals`
    *
-   * @return the return value from the UDP socket
+   * @return the time of the last of them, at which their datagram is sent, or 0
+   * if the pacer is paused
+   */
+  uint64_t scheduleDatagram(uint64_t *arrivals) {
+    for (unsigned i = 0; i < batchSize; i++)
+      if (!(arrivals[i] = pacer->next())) return 0;
+    return arrivals[batchSize - 1];
+  }
+
+  /**
+   * @brief generates a datagram of `numRequests` requests at `p`, which must
+   * have room for them, intended to be sent at `arrivals`
    */
-  Err::SocketError genAndSendPacket() {
-    struct packet p = {
-        .leave_client_timestamp = getTimeStamp(),
-        .data = serviceTimeGenerator->generate(),
-    };
-    return udpSocket->sendPacket(&p);
+  void genPacket(struct packet *p, unsigned numRequests, const uint64_t *arrivals) {
+    memset(p, 0, PACKET_SIZE(numRequests));
+    struct packet_request *requests = (struct packet_request *)(p + 1);
+
+    p->version = PACKET_VERSION;
+    p->num_requests = numRequests;
+    for (unsigned i = 0; i < numRequests; i++) {
+      requests[i].id = nextRequestId++;
+      requests[i].service_time = serviceTimeGenerator->generate();
+      requests[i].deadline_us = deadlineGenerator->generate();
+      requests[i].intended_send_timestamp = arrivals[i];
+    }
+
+    p->leave_client_timestamp = getTimeStamp();
   }
 };
 
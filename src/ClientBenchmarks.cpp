@@ -3,6 +3,7 @@
  */
 
 #include <Benchmark.hpp>
+#include <ClientBenchmarks.hpp>
 #include <string>
 #include <vector>
 
@@ -10,11 +11,22 @@
 #define DFL_NUM_CLIENTS 5  // note that 2 threads will be spawned per client
 #define DFL_THROUGHPUT 1'000
 
+/// shapes the load of all clients of `benchmark`
+static void applyLoadOptions(Benchmark& benchmark, const LoadOptions& load) {
+  if (!load.deadlinesUs.empty()) {
+    std::vector<double> probabilities(load.deadlineWeights.begin(), load.deadlineWeights.end());
+    std::vector<unsigned int> deadlines(load.deadlinesUs.begin(), load.deadlinesUs.end());
+    benchmark.setDeadlineMix(probabilities, deadlines);
+  }
+  benchmark.setBatchSize(load.batchSize);
+  benchmark.setArrivalProcess(load.arrivals, load.replayGapsNanos);
+}
+
 /**
  * Runs a short benchmark at the default throughput. Useful for debugging that
  * the server is correctly returning packets at a low throughput.
  */
-void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients) {
+void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load) {
   auto benchRet = Benchmark::create(serverIP, benchmarkPort, numClients, DFL_WINDOW_DURATION, DFL_THROUGHPUT);
   if (benchRet.second != Err::NoError) {
     std::cerr << "benchmark creation failure" << std::endl;
@@ -22,6 +34,7 @@ void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients) {
   }
 
   std::unique_ptr<Benchmark> benchmark = std::move(benchRet.first);
+  applyLoadOptions(*benchmark, load);
   std::cout << "client benchmark constructed" << std::endl;
   benchmark->run();
 }
@@ -30,7 +43,7 @@ void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients) {
  * runs a bimodal benchmark at increasing throughputs for 30 seconds.
  * Throughput grows exponentially at a rate of 5 seconds, starting at 10k Rps
  */
-void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients) {
+void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load) {
   // one-minute worth of default-duration windows
   std::vector<int> durations(6, DFL_WINDOW_DURATION);
   std::vector<int> throughputs;
@@ -48,6 +61,7 @@ void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int num
   }
 
   std::unique_ptr<Benchmark> benchmark = std::move(benchRet.first);
+  applyLoadOptions(*benchmark, load);
   std::cout << "client benchmark constructed" << std::endl;
   benchmark->run();
 }
@@ -56,7 +70,7 @@ void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int num
  * runs a unimodal benchmark at increasing throughputs for 30 seconds.
  * Throughput grows exponentially at a rate of 5 seconds, starting at 10k Rps
  */
-void unimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients) {
+void unimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load) {
   // one-minute worth of default-duration windows
   std::vector<int> durations(6, DFL_WINDOW_DURATION);
   std::vector<int> throughputs;
@@ -74,6 +88,7 @@ void unimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int nu
   }
 
   std::unique_ptr<Benchmark> benchmark = std::move(benchRet.first);
+  applyLoadOptions(*benchmark, load);
   std::cout << "client benchmark constructed" << std::endl;
   benchmark->run();
 }
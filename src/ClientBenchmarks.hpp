@@ -1,10 +1,27 @@
 #ifndef _CLIENT_BENCHMARKS_H
 #define _CLIENT_BENCHMARKS_H
 
+#include <Pacer.hpp>
 #include <string>
+#include <vector>
 
-void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients);
-void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients);
-void unimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients);
+/**
+ * Shape of the load generated by every client of a benchmark. Requests get
+ * deadline `deadlinesUs[i]` with a probability proportional to
+ * `deadlineWeights[i]`, and are all best-effort if both are empty. Clients
+ * batch `batchSize` requests per datagram and schedule them following
+ * `arrivals`.
+ */
+struct LoadOptions {
+  std::vector<int> deadlinesUs;
+  std::vector<int> deadlineWeights;
+  int batchSize = 1;
+  Pacer::Process arrivals = Pacer::Process::Poisson;
+  std::vector<uint64_t> replayGapsNanos;  // inter-arrival times replayed with Pacer::Process::Replay
+};
+
+void debugBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load = {});
+void bimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load = {});
+void unimodalIncreasingBenchmark(std::string serverIP, int benchmarkPort, int numClients, const LoadOptions& load = {});
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef CONTROL_LOOP
+#define CONTROL_LOOP
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+// moves the cursor home and clears the screen, replaces forking `clear`
+#define ANSI_REDRAW "\033[H\033[2J"
+
+/**
+ * @brief periodic tick shared by the server control loops, driven by a timerfd
+ * waited on through epoll. Ticks are armed on an absolute interval, so time
+ * spent in a window does not delay the next one.
+ */
+class ControlLoop {
+ private:
+  int periodMs;
+  int timerFd = -1;
+  int epollFd = -1;
+  uint64_t missedWindows = 0;  // windows that elapsed while the loop was busy
+
+ public:
+  explicit ControlLoop(int periodMs) : periodMs(periodMs) {
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timerFd < 0) {
+      std::cerr << "timerfd_create failed: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+      std::cerr << "epoll_create1 failed: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = timerFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev)) {
+      std::cerr << "epoll_ctl failed: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    struct itimerspec spec = {};
+    spec.it_interval.tv_sec = periodMs / 1000;
+    spec.it_interval.tv_nsec = (long)(periodMs % 1000) * 1'000'000;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(timerFd, 0, &spec, nullptr)) {
+      std::cerr << "timerfd_settime failed: " << strerror(errno) << std::endl;
+      close(timerFd);
+      timerFd = -1;
+    }
+  }
+
+  ~ControlLoop() {
+    if (epollFd >= 0) close(epollFd);
+    if (timerFd >= 0) close(timerFd);
+  }
+
+  ControlLoop(const ControlLoop&) = delete;
+  ControlLoop& operator=(const ControlLoop&) = delete;
+
+  bool isValid() const { return timerFd >= 0 && epollFd >= 0 && periodMs > 0; }
+
+  /// @return number of control windows that fit in `durationSecs` seconds
+  int windowsIn(int durationSecs) const { return (int)(((long)durationSecs * 1000) / periodMs); }
+
+  int getPeriodMs() const { return periodMs; }
+
+  uint64_t getMissedWindows() const { return missedWindows; }
+
+  /**
+   * Blocks until the end of the current control window.
+   * @return the number of windows that elapsed since the last call, more than
+   * one if the loop was busy for longer than a window, or -1 on failure.
+   * Callers count all of them, such that an overloaded loop still ends in time
+   */
+  int waitForNextWindow() {
+    struct epoll_event ev;
+    int n;
+    do {
+      n = epoll_wait(epollFd, &ev, 1, -1);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return -1;
+
+    uint64_t expirations = 0;
+    if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) return -1;
+    if (expirations > 1) missedWindows += expirations - 1;
+    return (int)expirations;
+  }
+
+  /// starts a new frame of the display without forking a shell
+  static void redrawScreen() { std::cout << ANSI_REDRAW; }
+};
+
+#endif
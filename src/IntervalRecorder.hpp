@@ -0,0 +1,96 @@
+#ifndef _INTERVAL_RECORDER_H
+#define _INTERVAL_RECORDER_H
+
+#include <stdint.h>
+
+#include <LogLinearHistogram.hpp>
+#include <atomic>
+#include <limits>
+#include <mutex>
+
+/**
+ * Lets writers enter and leave critical sections wait-free, while a reader
+ * can wait for all writers that entered before a phase flip to have left,
+ * as HdrHistogram's WriterReaderPhaser.
+ *
+ * Writers of the even phase take non-negative tickets from `startEpoch`, and
+ * those of the odd phase negative ones. Flipping the phase resets
+ * `startEpoch` to the base of the other phase, and returns once the end
+ * counter of the previous phase has caught up with the tickets handed out.
+ */
+class WriterReaderPhaser {
+ public:
+  WriterReaderPhaser() : startEpoch(0), evenEndEpoch(0), oddEndEpoch(std::numeric_limits<int64_t>::min()) {}
+
+  /// @return the ticket to pass to `writerExit`
+  int64_t writerEnter() { return startEpoch.fetch_add(1); }
+
+  void writerExit(int64_t ticket) { (ticket < 0 ? oddEndEpoch : evenEndEpoch).fetch_add(1); }
+
+  /**
+   * @brief starts a new phase, and waits for the writers of the previous one.
+   * Must be called with `readerLock` held
+   */
+  void flipPhase() {
+    bool nextPhaseIsEven = startEpoch.load() < 0;
+    int64_t initialStartValue = nextPhaseIsEven ? 0 : std::numeric_limits<int64_t>::min();
+    (nextPhaseIsEven ? evenEndEpoch : oddEndEpoch).store(initialStartValue);
+
+    int64_t startValueAtFlip = startEpoch.exchange(initialStartValue);
+    std::atomic<int64_t>& previousEndEpoch = nextPhaseIsEven ? oddEndEpoch : evenEndEpoch;
+    // writers only hold the phase for a single record, this does not wait for long
+    while (previousEndEpoch.load() != startValueAtFlip) {
+    }
+  }
+
+  std::mutex readerLock;
+
+ private:
+  std::atomic<int64_t> startEpoch;
+  std::atomic<int64_t> evenEndEpoch;
+  std::atomic<int64_t> oddEndEpoch;
+};
+
+/**
+ * Records values into one of two LogLinearHistograms, so that another thread
+ * can take the values recorded since its last call without stopping or
+ * locking the recording thread: it swaps the histograms, waits for a record
+ * in progress on the old one through a WriterReaderPhaser, and then owns it.
+ */
+class IntervalRecorder {
+ public:
+  IntervalRecorder(unsigned precisionBits = DEFAULT_HISTOGRAM_PRECISION_BITS,
+                   uint64_t maxValue = DEFAULT_HISTOGRAM_MAX_VALUE)
+      : histograms{LogLinearHistogram(precisionBits, maxValue), LogLinearHistogram(precisionBits, maxValue)},
+        active(&histograms[0]) {}
+
+  IntervalRecorder(const IntervalRecorder&) = delete;
+  IntervalRecorder& operator=(const IntervalRecorder&) = delete;
+
+  /// records `value`, wait-free. May be called concurrently with `takeInterval`
+  void record(uint64_t value) {
+    int64_t ticket = phaser.writerEnter();
+    active.load()->record(value);
+    phaser.writerExit(ticket);
+  }
+
+  /// @return the values recorded since the last call, and resets them
+  LogLinearHistogram takeInterval() {
+    std::lock_guard<std::mutex> lock(phaser.readerLock);
+
+    LogLinearHistogram *previous = active.load();
+    active.store(previous == &histograms[0] ? &histograms[1] : &histograms[0]);
+    phaser.flipPhase();
+
+    LogLinearHistogram ret = *previous;
+    previous->reset();
+    return ret;
+  }
+
+ private:
+  LogLinearHistogram histograms[2];
+  std::atomic<LogLinearHistogram *> active;
+  WriterReaderPhaser phaser;
+};
+
+#endif
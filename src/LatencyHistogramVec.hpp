@@ -3,9 +3,10 @@
 
 #include <stdint.h>
 
+#include <LogLinearHistogram.hpp>
+#include <algorithm>
 #include <fstream>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 /**
@@ -14,7 +15,7 @@
  */
 struct LabelValues {
   uint64_t throughput;
-  uint8_t serviceTime;
+  uint16_t serviceTime;
 
   bool operator==(const LabelValues& other) const {
     return throughput == other.throughput && serviceTime == other.serviceTime;
@@ -23,28 +24,23 @@ struct LabelValues {
 
 /**
  * Defines a series of latency histograms labeled by throughput and service
- * time.
+ * time, see `LogLinearHistogram` for their precision. Both labels take a few
+ * values only (one throughput per window, a handful of service times), so the
+ * histograms are indexed by the dense ranks of their labels, without hashing.
  * This data structure is NOT thread safe - the idea is that each client will
  * maintain their own version, and some main thread will merge them together
  * in the post-processing stage before writing them out.
  */
 class LatencyHistogramVec {
  public:
-  LatencyHistogramVec(long bucketWidthNanos = 1000 /* 1us */) : bucketWidthNanos(bucketWidthNanos) {}
+  LatencyHistogramVec(unsigned precisionBits = DEFAULT_HISTOGRAM_PRECISION_BITS,
+                      uint64_t maxNanos = DEFAULT_HISTOGRAM_MAX_VALUE)
+      : precisionBits(precisionBits), maxNanos(maxNanos) {}
 
   ~LatencyHistogramVec(){};
 
   // increments the histogram entry for a recorded measurement
-  void increment(LabelValues measurement, long nanos) {
-    int idx = getEntryIdx(measurement);
-    if (idx < 0) {
-      addEntry(measurement);
-      idx = labels.size() - 1;
-    }
-
-    long roundedNanos = (nanos / bucketWidthNanos) * bucketWidthNanos;
-    histogramVec[idx][roundedNanos]++;
-  }
+  void increment(LabelValues measurement, long nanos) { histogramVec[getOrAddEntryIdx(measurement)].record(nanos); }
 
   // writes the histogram out as a .csv. Returns -1 on failure, number of rows
   // written (excl. the header row) on success
@@ -60,15 +56,11 @@ class LatencyHistogramVec {
     int rows = 0;
     for (unsigned i = 0; i < labels.size(); i++) {
       LabelValues label = labels[i];
-      auto hist = histogramVec[i];
-
-      for (auto bucketCount : hist) {
-        auto bucket = bucketCount.first;
-        auto count = bucketCount.second;
 
+      histogramVec[i].forEachBucket([&](uint64_t bucket, uint64_t count) {
         file << bucket << "," << count << "," << label.throughput << "," << (int)label.serviceTime << "\n";
         rows++;
-      }
+      });
     }
 
     file.close();
@@ -76,52 +68,65 @@ class LatencyHistogramVec {
   }
 
   // Merges the current histogram with another histogram - i.e. increments all
-  // counts by those found in other, and adds any values that do not exist in
-  // this histogram.
-  // It is a requirement that both latency histograms have the same label
-  // values sequence - this is checked at runtime.
+  // counts by those found in other, and adds any labels that do not exist in
+  // this histogram. Returns -1 if the histograms differ in precision or range
   int mergeWith(const LatencyHistogramVec& other) {
-    if (labels.size() != other.labels.size()) return -1;
-
-    for (unsigned i = 0; i < labels.size(); i++) {
-      if (labels[i] != other.labels[i]) return -1;
-    }
-
-    for (unsigned i = 0; i < histogramVec.size(); i++) {
-      std::unordered_map<long, long>& thisHist = histogramVec[i];
-      const std::unordered_map<long, long>& otherHist = other.histogramVec[i];
+    if (precisionBits != other.precisionBits || maxNanos != other.maxNanos) return -1;
 
-      for (auto bucketCount : otherHist) {
-        long bucket = bucketCount.first;
-        long count = bucketCount.second;
-
-        thisHist[bucket] += count;
-      }
+    for (unsigned i = 0; i < other.labels.size(); i++) {
+      size_t idx = getOrAddEntryIdx(other.labels[i]);
+      histogramVec[idx].mergeWith(other.histogramVec[i]);
     }
 
     return 0;
   }
 
+  // returns the `percentile`-th percentile, in [0, 100], of the measurements of
+  // all labels in nanoseconds
+  uint64_t valueAtPercentile(double percentile) const {
+    LogLinearHistogram all(precisionBits, maxNanos);
+    for (auto& hist : histogramVec) all.mergeWith(hist);
+    return all.valueAtPercentile(percentile);
+  }
+
   const std::vector<LabelValues> getLabelValues() { return labels; }
 
  private:
-  std::vector<std::unordered_map<long, long>> histogramVec;
-  std::vector<LabelValues> labels;
-  int bucketWidthNanos;
-
-  // inserts a new entry at the end of the histogram vec
-  void addEntry(LabelValues measurement) {
-    labels.push_back(measurement);
-    histogramVec.emplace_back();
-  }
+  std::vector<LogLinearHistogram> histogramVec;
+  std::vector<LabelValues> labels;             // of the entries of `histogramVec`
+  std::vector<uint64_t> throughputs;           // by rank, in order of first measurement
+  std::vector<int32_t> serviceTimeRanks;       // by service time, -1 if not measured yet
+  int32_t numServiceTimes = 0;                 // ranks handed out
+  std::vector<std::vector<int32_t>> entryIdx;  // by throughput then service time rank, -1 if none
+  size_t lastThroughputRank = 0;
+  unsigned precisionBits;
+  uint64_t maxNanos;
+
+  // returns the index of the entry with the provided label values, inserting
+  // a new entry at the end of the histogram vec if it does not exist
+  size_t getOrAddEntryIdx(LabelValues measurement) {
+    // the throughput only changes between windows, its few values are scanned then
+    if (lastThroughputRank >= throughputs.size() || throughputs[lastThroughputRank] != measurement.throughput) {
+      auto it = std::find(throughputs.begin(), throughputs.end(), measurement.throughput);
+      lastThroughputRank = it - throughputs.begin();
+      if (it == throughputs.end()) {
+        throughputs.push_back(measurement.throughput);
+        entryIdx.emplace_back();
+      }
+    }
 
-  // returns the index of the entry with the provided label values, or -1 if
-  // it does not exist
-  int getEntryIdx(LabelValues measurement) {
-    for (unsigned i = 0; i < labels.size(); i++) {
-      if (labels[i] == measurement) return i;
+    if (measurement.serviceTime >= serviceTimeRanks.size()) serviceTimeRanks.resize(measurement.serviceTime + 1, -1);
+    int32_t& serviceTimeRank = serviceTimeRanks[measurement.serviceTime];
+    if (serviceTimeRank < 0) serviceTimeRank = numServiceTimes++;
+
+    std::vector<int32_t>& row = entryIdx[lastThroughputRank];
+    if ((size_t)serviceTimeRank >= row.size()) row.resize(serviceTimeRank + 1, -1);
+    if (row[serviceTimeRank] < 0) {
+      row[serviceTimeRank] = labels.size();
+      labels.push_back(measurement);
+      histogramVec.emplace_back(precisionBits, maxNanos);
     }
-    return -1;
+    return row[serviceTimeRank];
   }
 };
 
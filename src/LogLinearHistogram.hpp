@@ -0,0 +1,108 @@
+#ifndef _LOG_LINEAR_HISTOGRAM_H
+#define _LOG_LINEAR_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#define DEFAULT_HISTOGRAM_PRECISION_BITS 7          // < 1% relative error
+#define DEFAULT_HISTOGRAM_MAX_VALUE 60'000'000'000  // 1 minute in ns
+
+/**
+ * Fixed-memory histogram with log-linear buckets, in the style of
+ * HdrHistogram: values below 2^(precisionBits + 1) have a bucket each, and
+ * every further power of two is split into 2^precisionBits buckets, bounding
+ * the relative error of a recorded value by 2^-precisionBits. Values above
+ * `maxValue` are recorded as `maxValue`.
+ *
+ * Recording computes the bucket from the leading zeros of the value, without
+ * branching or allocating. Histograms of the same precision and range merge
+ * by adding their bucket arrays.
+ */
+class LogLinearHistogram {
+ public:
+  LogLinearHistogram(unsigned precisionBits = DEFAULT_HISTOGRAM_PRECISION_BITS,
+                     uint64_t maxValue = DEFAULT_HISTOGRAM_MAX_VALUE)
+      : precisionBits(precisionBits),
+        maxValue(maxValue),
+        counts(bucketIdx(maxValue, precisionBits) + 1, 0),
+        totalCount(0) {}
+
+  void record(uint64_t value, uint64_t count = 1) {
+    counts[bucketIdx(std::min(value, maxValue), precisionBits)] += count;
+    totalCount += count;
+  }
+
+  /// adds the counts of `other`. Returns -1 if both differ in precision or range
+  int mergeWith(const LogLinearHistogram& other) {
+    if (precisionBits != other.precisionBits || maxValue != other.maxValue) return -1;
+
+    uint64_t *dst = counts.data();
+    const uint64_t *src = other.counts.data();
+    for (size_t i = 0; i < counts.size(); i++) dst[i] += src[i];
+    totalCount += other.totalCount;
+    return 0;
+  }
+
+  /**
+   * @return the lowest value of the bucket holding the `percentile`-th
+   * percentile, in [0, 100], of the recorded values. 0 if there are none
+   */
+  uint64_t valueAtPercentile(double percentile) const {
+    if (totalCount == 0) return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(percentile / 100.0 * totalCount));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+      seen += counts[i];
+      if (seen >= rank) return bucketValue(i);
+    }
+    return maxValue;
+  }
+
+  uint64_t getTotalCount() const { return totalCount; }
+
+  /// clears all counts, keeping the precision and range
+  void reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    totalCount = 0;
+  }
+
+  /// calls `f(value, count)` with the lowest value of every non-empty bucket, in increasing order
+  template <typename F>
+  void forEachBucket(F f) const {
+    for (size_t i = 0; i < counts.size(); i++)
+      if (counts[i]) f(bucketValue(i), counts[i]);
+  }
+
+ private:
+  unsigned precisionBits;
+  uint64_t maxValue;
+  std::vector<uint64_t> counts;
+  uint64_t totalCount;
+
+  /**
+   * Values in [2^m, 2^(m + 1)) with m > precisionBits are shifted right by
+   * m - precisionBits, leaving them in [2^precisionBits, 2^(precisionBits + 1)),
+   * and take the (m - precisionBits + 1)-th run of 2^precisionBits buckets.
+   * Smaller values have shift 0 and a bucket each.
+   */
+  static size_t bucketIdx(uint64_t value, unsigned precisionBits) {
+    uint64_t subBuckets = 1ULL << precisionBits;
+    unsigned magnitude = 63 - __builtin_clzll(value | subBuckets);
+    unsigned shift = magnitude - precisionBits;
+    return shift * subBuckets + (value >> shift);
+  }
+
+  /// @return the lowest value of bucket `idx`, the inverse of `bucketIdx`
+  uint64_t bucketValue(size_t idx) const {
+    uint64_t subBuckets = 1ULL << precisionBits;
+    if (idx < 2 * subBuckets) return idx;
+    unsigned shift = idx / subBuckets - 1;
+    return (idx - shift * subBuckets) << shift;
+  }
+};
+
+#endif
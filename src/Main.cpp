@@ -10,11 +10,21 @@
 #include <ProgramOptions.hpp>
 #include <ServerBenchmark.hpp>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
 namespace {
 
+/// parses a comma-separated list of integers, e.g. "4,2,2"
+std::vector<int> parseIntList(const std::string& list) {
+  std::vector<int> values;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) values.push_back(std::stoi(item));
+  return values;
+}
+
 [[noreturn]] void Usage() {
   std::string logo =
       "   _____  _____ _  _ ______ ______   _               ____    __ \n"
@@ -31,20 +41,99 @@ namespace {
   std::cout << "-m/--mode = <client/server>: decides whether to run client or server program" << std::endl;
   std::cout << "-p/--port: Port that server benchmark listens on" << std::endl;
   std::cout << "-d/--duration: duration of benchmark in seconds . Defaults to 60 secs" << std::endl;
+  std::cout << "--period_ms: period of the server control loop and display, at least " << MIN_CONTROL_PERIOD_MS
+            << " ms. Defaults to 1000 ms" << std::endl;
+  std::cout << "--trace_sample: trace one in N scheduling decisions to server_results/sched_trace.bin. Defaults to 0"
+            << " (disabled)" << std::endl;
   std::cout << std::endl;
   std::cout << "-n/--num_clients: number of clients in client benchmark" << std::endl;
   std::cout << "-a/--addr: ip address of the server (supports IPv4)" << std::endl;
   std::cout << "-D/--distribution = <bimodal/unimodal/debug>: distribution of client-generated traffic"
             << std::endl;
+  std::cout << "--deadlines_us: comma-separated request deadlines in us, 0 being best-effort. Defaults to 0"
+            << std::endl;
+  std::cout << "--deadline_weights: comma-separated relative frequencies of --deadlines_us" << std::endl;
+  std::cout << "--batch: number of requests batched into a datagram, sent when the last of them is due. At most "
+            << PACKET_MAX_REQUESTS << ", defaults to 1" << std::endl;
+  std::cout << "--arrivals = <poisson/constant/replay>: inter-arrival time distribution of the requests of a client."
+            << " Defaults to poisson" << std::endl;
+  std::cout << "--arrival_trace: file of inter-arrival times in ns, one per line, replayed at the benchmark's rate"
+            << " (replay arrivals)" << std::endl;
   std::cout << std::endl;
   std::cout << "-i/--ifname: network interface bpf program will be attached to" << std::endl;
-  std::cout << "-P/--policy = <rr/rrcs/dca>: RSS policy for server benchmark" << std::endl;
+  std::cout << "-P/--policy = <rr/rrcs/acs/tiered/edf/dca/dcau/jsq/p2c/hash>: RSS policy for server benchmark"
+            << std::endl;
   std::cout << "-c/--cpus: total number of cpus for server benchmark" << std::endl;
-  std::cout << "-R/--reserved_long: number of cores reserved for long requests (core separated policy)" << std::endl;
+  std::cout << "-R/--reserved_long: number of cores reserved for long requests (core separated policies). Initial "
+               "split for acs"
+            << std::endl;
+  std::cout << "-B/--tier_bounds: comma-separated, increasing service time bounds between tiers (tiered policy)"
+            << std::endl;
+  std::cout << "-T/--tier_cpus: comma-separated number of cores of every tier, summing up to --cpus (tiered policy)"
+            << std::endl;
+  std::cout << "--latency_cpus: number of cores reserved for requests with a tight deadline (edf policy)" << std::endl;
+  std::cout << "--tight_deadline_us: deadline in us up to which a request is latency-critical (edf policy)."
+            << " Defaults to 100" << std::endl;
+  std::cout << "--spill_threshold: outstanding requests of the hashed cpu above which the hash policy spills a packet"
+            << " to the least loaded cpu. Defaults to 0 (never)" << std::endl;
+  std::cout << "--steal_threshold: outstanding requests of a cpu from which it hands requests over to an idle cpu"
+            << " of the group (single group policies). Defaults to 0 (never)" << std::endl;
+  std::cout << "--steal_hops: number of times a request may be handed over. Defaults to 1" << std::endl;
+  std::cout << "--qsize: packets held by the cpumap queue of every cpu. Defaults to " << DEFAULT_CPUMAP_QSIZE
+            << ", at most " << MAX_CPUMAP_QSIZE << std::endl;
+  std::cout << "--qsize_long: cpumap queue size of the cpus taking long requests (long group of rrcs/acs, last tier)."
+            << " Defaults to --qsize" << std::endl;
+  std::cout << "--admission_deadline_us: sheds requests whose predicted queuing delay exceeds this many us."
+            << " Defaults to 0 (admit all)" << std::endl;
+  std::cout << "--admission_reply: replies to shed requests with an overloaded flag instead of dropping them"
+            << std::endl;
+  std::cout << "--flow_hash: dca(u) steers flows by consistent hashing instead of round-robin" << std::endl;
+  std::cout << "--scale_up_qd: smoothed queuing delay in us above which dca adds a core. Defaults to 200" << std::endl;
+  std::cout << "--scale_down_qd: smoothed queuing delay in us below which dca may remove a core. Defaults to 50"
+            << std::endl;
+  std::cout << "--p99_target_us: p99 queuing delay in us that dca scales towards, adding cores in proportion to the"
+            << " violation. Replaces the --scale_*_qd thresholds when set" << std::endl;
+  std::cout << "--p99_gain: proportional gain of dca's p99 controller. Defaults to 1.0" << std::endl;
+  std::cout << "--scale_up_util: cpu utilization in [0, 1] above which dcau adds a core. Defaults to 0.5" << std::endl;
+  std::cout << "--scale_down_util: cpu utilization in [0, 1] below which dca(u) may remove a core. Defaults to 0.3"
+            << std::endl;
+  std::cout << "--cooldown: number of control windows without scaling after dca(u) scales. Defaults to 3"
+            << std::endl;
+  std::cout << "--ewma_alpha: weight in (0, 1] of the latest queuing delay in dca's smoothed delay. Defaults to 0.5"
+            << std::endl;
   std::cout << std::endl << "Report any bugs to RS3Lab <rs3lab@groupes.epfl.ch>" << std::endl;
   std::exit(1);
 }
 
+// long options without a short equivalent
+enum LongOnlyOption {
+  OPT_PERIOD_MS = 256,
+  OPT_TRACE_SAMPLE,
+  OPT_SCALE_UP_QD,
+  OPT_SCALE_DOWN_QD,
+  OPT_P99_TARGET,
+  OPT_P99_GAIN,
+  OPT_SCALE_UP_UTIL,
+  OPT_SCALE_DOWN_UTIL,
+  OPT_COOLDOWN,
+  OPT_EWMA_ALPHA,
+  OPT_SPILL_THRESHOLD,
+  OPT_FLOW_HASH,
+  OPT_STEAL_THRESHOLD,
+  OPT_STEAL_HOPS,
+  OPT_QSIZE,
+  OPT_QSIZE_LONG,
+  OPT_ADMISSION_DEADLINE,
+  OPT_ADMISSION_REPLY,
+  OPT_LATENCY_CPUS,
+  OPT_TIGHT_DEADLINE,
+  OPT_DEADLINES,
+  OPT_DEADLINE_WEIGHTS,
+  OPT_BATCH,
+  OPT_ARRIVALS,
+  OPT_ARRIVAL_TRACE,
+};
+
 }  // namespace
 
 int doServerBenchmark(ProgramOptions& programOpts);
@@ -64,16 +153,43 @@ int main(int argc, char *argv[]) {
       {"cpus", optional_argument, 0, 'c'},
       {"policy", optional_argument, 0, 'P'},
       {"reserved_long", optional_argument, 0, 'R'},
+      {"tier_bounds", optional_argument, 0, 'B'},
+      {"tier_cpus", optional_argument, 0, 'T'},
+      {"period_ms", required_argument, 0, OPT_PERIOD_MS},
+      {"trace_sample", required_argument, 0, OPT_TRACE_SAMPLE},
+      {"scale_up_qd", required_argument, 0, OPT_SCALE_UP_QD},
+      {"scale_down_qd", required_argument, 0, OPT_SCALE_DOWN_QD},
+      {"p99_target_us", required_argument, 0, OPT_P99_TARGET},
+      {"p99_gain", required_argument, 0, OPT_P99_GAIN},
+      {"scale_up_util", required_argument, 0, OPT_SCALE_UP_UTIL},
+      {"scale_down_util", required_argument, 0, OPT_SCALE_DOWN_UTIL},
+      {"cooldown", required_argument, 0, OPT_COOLDOWN},
+      {"ewma_alpha", required_argument, 0, OPT_EWMA_ALPHA},
+      {"spill_threshold", required_argument, 0, OPT_SPILL_THRESHOLD},
+      {"flow_hash", no_argument, 0, OPT_FLOW_HASH},
+      {"steal_threshold", required_argument, 0, OPT_STEAL_THRESHOLD},
+      {"steal_hops", required_argument, 0, OPT_STEAL_HOPS},
+      {"qsize", required_argument, 0, OPT_QSIZE},
+      {"qsize_long", required_argument, 0, OPT_QSIZE_LONG},
+      {"admission_deadline_us", required_argument, 0, OPT_ADMISSION_DEADLINE},
+      {"admission_reply", no_argument, 0, OPT_ADMISSION_REPLY},
+      {"latency_cpus", required_argument, 0, OPT_LATENCY_CPUS},
+      {"tight_deadline_us", required_argument, 0, OPT_TIGHT_DEADLINE},
 
       /* used by client benchmark */
       {"num_clients", optional_argument, 0, 'n'},
       {"addr", optional_argument, 0, 'a'},
       {"distribution", optional_argument, 0, 'D'},
+      {"deadlines_us", required_argument, 0, OPT_DEADLINES},
+      {"deadline_weights", required_argument, 0, OPT_DEADLINE_WEIGHTS},
+      {"batch", required_argument, 0, OPT_BATCH},
+      {"arrivals", required_argument, 0, OPT_ARRIVALS},
+      {"arrival_trace", required_argument, 0, OPT_ARRIVAL_TRACE},
 
       {0, 0, 0, 0},
   };
 
-  while ((opt = getopt_long(argc, argv, "h:m:p:d:i:c:P:R:n:a:v:T:D:S:I:t:", longOptions, NULL)) != -1) {
+  while ((opt = getopt_long(argc, argv, "h:m:p:d:i:c:P:R:B:n:a:v:T:D:S:I:t:", longOptions, NULL)) != -1) {
     switch (opt) {
       case 'h':
         Usage();
@@ -99,6 +215,87 @@ int main(int argc, char *argv[]) {
       case 'R':
         programOpts.numLongCpus = std::stoi(optarg);
         break;
+      case 'B':
+        programOpts.tierBounds = parseIntList(optarg);
+        break;
+      case 'T':
+        programOpts.tierCpus = parseIntList(optarg);
+        break;
+      case OPT_PERIOD_MS:
+        programOpts.periodMs = std::stoi(optarg);
+        break;
+      case OPT_TRACE_SAMPLE:
+        programOpts.traceSampleRate = std::stoi(optarg);
+        break;
+      case OPT_SCALE_UP_QD:
+        programOpts.dca.scaleUpDelayUs = std::stod(optarg);
+        break;
+      case OPT_SCALE_DOWN_QD:
+        programOpts.dca.scaleDownDelayUs = std::stod(optarg);
+        break;
+      case OPT_P99_TARGET:
+        programOpts.dca.p99TargetUs = std::stod(optarg);
+        break;
+      case OPT_P99_GAIN:
+        programOpts.dca.p99Gain = std::stod(optarg);
+        break;
+      case OPT_SCALE_UP_UTIL:
+        programOpts.dca.scaleUpUtilization = std::stod(optarg);
+        break;
+      case OPT_SCALE_DOWN_UTIL:
+        programOpts.dca.scaleDownUtilization = std::stod(optarg);
+        break;
+      case OPT_COOLDOWN:
+        programOpts.dca.cooldownWindows = std::stoi(optarg);
+        break;
+      case OPT_EWMA_ALPHA:
+        programOpts.dca.ewmaAlpha = std::stod(optarg);
+        break;
+      case OPT_SPILL_THRESHOLD:
+        programOpts.spillThreshold = std::stoi(optarg);
+        break;
+      case OPT_FLOW_HASH:
+        programOpts.dca.flowHash = true;
+        break;
+      case OPT_STEAL_THRESHOLD:
+        programOpts.stealThreshold = std::stoi(optarg);
+        break;
+      case OPT_STEAL_HOPS:
+        programOpts.stealMaxHops = std::stoi(optarg);
+        break;
+      case OPT_QSIZE:
+        programOpts.qsize = std::stoi(optarg);
+        break;
+      case OPT_QSIZE_LONG:
+        programOpts.qsizeLong = std::stoi(optarg);
+        break;
+      case OPT_ADMISSION_DEADLINE:
+        programOpts.admissionDeadlineUs = std::stoi(optarg);
+        break;
+      case OPT_ADMISSION_REPLY:
+        programOpts.admissionReply = true;
+        break;
+      case OPT_LATENCY_CPUS:
+        programOpts.numLatencyCpus = std::stoi(optarg);
+        break;
+      case OPT_TIGHT_DEADLINE:
+        programOpts.tightDeadlineUs = std::stoi(optarg);
+        break;
+      case OPT_DEADLINES:
+        programOpts.deadlinesUs = parseIntList(optarg);
+        break;
+      case OPT_DEADLINE_WEIGHTS:
+        programOpts.deadlineWeights = parseIntList(optarg);
+        break;
+      case OPT_BATCH:
+        programOpts.batchSize = std::stoi(optarg);
+        break;
+      case OPT_ARRIVALS:
+        programOpts.arrivals = optarg;
+        break;
+      case OPT_ARRIVAL_TRACE:
+        programOpts.arrivalTrace = optarg;
+        break;
       case 'n':
         programOpts.numClients = std::stoi(optarg);
         break;
@@ -125,26 +322,52 @@ int main(int argc, char *argv[]) {
 }
 
 void doClientBenchmark(ProgramOptions& programOpts) {
+  LoadOptions load = {
+      .deadlinesUs = programOpts.deadlinesUs,
+      .deadlineWeights = programOpts.deadlineWeights,
+      .batchSize = programOpts.batchSize,
+  };
+
+  if (programOpts.arrivals == ARRIVALS_CONSTANT) {
+    load.arrivals = Pacer::Process::Constant;
+  } else if (programOpts.arrivals == ARRIVALS_REPLAY) {
+    load.arrivals = Pacer::Process::Replay;
+    load.replayGapsNanos = Pacer::readReplayGaps(programOpts.arrivalTrace);
+    if (load.replayGapsNanos.empty()) {
+      std::cerr << "No inter-arrival times in " << programOpts.arrivalTrace << std::endl;
+      exit(1);
+    }
+  }
+
   if (programOpts.distribution == CLIENT_MODE_BIMODAL)
-    bimodalIncreasingBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients);
+    bimodalIncreasingBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients, load);
   else if (programOpts.distribution == CLIENT_MODE_UNIMODAL)
-    unimodalIncreasingBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients);
+    unimodalIncreasingBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients, load);
   else if (programOpts.distribution == CLIENT_MODE_DEBUG)
-    debugBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients);
+    debugBenchmark(programOpts.serverIP, programOpts.port, programOpts.numClients, load);
   else
     Usage();
 }
 
 int doServerBenchmark(ProgramOptions& programOpts) {
   std::cout << "server benchmark" << std::endl;
+  configureWorkStealing(programOpts.stealThreshold, programOpts.stealMaxHops);
+  configureAdmissionControl(programOpts.admissionDeadlineUs, programOpts.admissionReply);
+  configureCpumapQueues(programOpts.qsize, programOpts.qsizeLong > 0 ? programOpts.qsizeLong : programOpts.qsize);
   if (programOpts.serverPolicy == std::string(POLICY_ROUNDROBIN)) {
     std::cout << "Launching round-robin without core-separation" << std::endl;
     std::vector<int> cpus;
     for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
-    return redirectProgRoundRobin(cpus, programOpts.ifname, programOpts.port, programOpts.duration);
+    return redirectProgRoundRobin(cpus, programOpts.ifname, programOpts.port, programOpts.duration,
+                                  programOpts.periodMs, programOpts.traceSampleRate);
 
-  } else if (programOpts.serverPolicy == std::string(POLICY_ROUNDROBIN_CORE_SEP)) {
-    std::cout << "Launching round-robin with core-separation" << std::endl;
+  } else if (programOpts.serverPolicy == std::string(POLICY_ROUNDROBIN_CORE_SEP) ||
+             programOpts.serverPolicy == std::string(POLICY_ADAPTIVE_CORE_SEP)) {
+    bool adaptiveSplit = programOpts.serverPolicy == std::string(POLICY_ADAPTIVE_CORE_SEP);
+    if (adaptiveSplit)
+      std::cout << "Launching round-robin with adaptive core-separation" << std::endl;
+    else
+      std::cout << "Launching round-robin with core-separation" << std::endl;
     std::vector<int> cpusShort;
     std::vector<int> cpusLong;
 
@@ -164,13 +387,66 @@ int doServerBenchmark(ProgramOptions& programOpts) {
     }
     std::cout << "]" << std::endl;
     return redirectProgRoundRobinCoreSeparated(cpusShort, cpusLong, programOpts.ifname, programOpts.port,
-                                               programOpts.duration);
+                                               programOpts.duration, programOpts.periodMs, programOpts.traceSampleRate,
+                                               adaptiveSplit);
+
+  } else if (programOpts.serverPolicy == std::string(POLICY_DEADLINE)) {
+    std::cout << "Launching deadline-aware scheduling" << std::endl;
+    std::vector<int> cpusLowLatency;
+    std::vector<int> cpusBestEffort;
+
+    for (int i = 0; i < programOpts.numLatencyCpus; i++) cpusLowLatency.push_back(i);
+    for (int i = programOpts.numLatencyCpus; i < programOpts.numCpus; i++) cpusBestEffort.push_back(i);
+
+    return redirectProgDeadline(cpusLowLatency, cpusBestEffort, programOpts.ifname, programOpts.port,
+                                programOpts.duration, programOpts.periodMs, programOpts.traceSampleRate,
+                                programOpts.tightDeadlineUs);
+
+  } else if (programOpts.serverPolicy == std::string(POLICY_TIERED)) {
+    std::cout << "Launching round-robin with tiered core-separation" << std::endl;
+    std::vector<std::vector<int>> tierCpus;
+    int cpu = 0;
+
+    for (int numTierCpus : programOpts.tierCpus) {
+      std::vector<int> cpus;
+      for (int i = 0; i < numTierCpus; i++) cpus.push_back(cpu++);
+      tierCpus.push_back(cpus);
+    }
+
+    return redirectProgTiered(tierCpus, programOpts.tierBounds, programOpts.ifname, programOpts.port,
+                              programOpts.duration, programOpts.periodMs, programOpts.traceSampleRate);
 
   } else if (programOpts.serverPolicy == std::string(POLICY_DYNAMIC_CORE_ALLOC)) {
     std::cout << "Launching dynamic core allocation prog" << std::endl;
     std::vector<int> cpus;
     for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
-    return redirectProgDynamicCoreAllocation(cpus, programOpts.ifname, programOpts.port, programOpts.duration);
+    return redirectProgDynamicCoreAllocation(cpus, programOpts.ifname, programOpts.port, programOpts.duration,
+                                             programOpts.periodMs, programOpts.traceSampleRate, programOpts.dca);
+  } else if (programOpts.serverPolicy == std::string(POLICY_DYNAMIC_CORE_ALLOC_UTILIZATION)) {
+    std::cout << "Launching utilization-driven dynamic core allocation prog" << std::endl;
+    std::vector<int> cpus;
+    for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
+    return redirectProgDynamicCoreAllocationUtilization(cpus, programOpts.ifname, programOpts.port,
+                                                        programOpts.duration, programOpts.periodMs,
+                                                        programOpts.traceSampleRate, programOpts.dca);
+  } else if (programOpts.serverPolicy == std::string(POLICY_JOIN_SHORTEST_QUEUE)) {
+    std::cout << "Launching join-shortest-queue" << std::endl;
+    std::vector<int> cpus;
+    for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
+    return redirectProgJoinShortestQueue(cpus, programOpts.ifname, programOpts.port, programOpts.duration,
+                                         programOpts.periodMs, programOpts.traceSampleRate);
+  } else if (programOpts.serverPolicy == std::string(POLICY_POWER_OF_TWO)) {
+    std::cout << "Launching power-of-two-choices" << std::endl;
+    std::vector<int> cpus;
+    for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
+    return redirectProgPowerOfTwo(cpus, programOpts.ifname, programOpts.port, programOpts.duration,
+                                  programOpts.periodMs, programOpts.traceSampleRate);
+  } else if (programOpts.serverPolicy == std::string(POLICY_FLOW_HASH)) {
+    std::cout << "Launching flow-affinity consistent hashing" << std::endl;
+    std::vector<int> cpus;
+    for (int i = 0; i < programOpts.numCpus; i++) cpus.push_back(i);
+    return redirectProgFlowHash(cpus, programOpts.ifname, programOpts.port, programOpts.duration,
+                                programOpts.periodMs, programOpts.traceSampleRate, programOpts.spillThreshold);
   } else {
     Usage();
   }
@@ -0,0 +1,200 @@
+#ifndef _PACER_H
+#define _PACER_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define PACER_SPIN_NANOS 50'000           // waits shorter than this are spun
+#define PACER_MAX_SLEEP_NANOS 1'000'000  // sleeps are cut into chunks to notice stops
+
+/**
+ * @brief how far sends drifted from their scheduled time
+ */
+struct DriftStats {
+  uint64_t sends = 0;
+  uint64_t totalNanos = 0;
+  uint64_t maxNanos = 0;
+
+  DriftStats& operator+=(const DriftStats& other) {
+    sends += other.sends;
+    totalNanos += other.totalNanos;
+    maxNanos = std::max(maxNanos, other.maxNanos);
+    return *this;
+  }
+
+  uint64_t avgNanos() const { return sends ? totalNanos / sends : 0; }
+};
+
+/**
+ * Open-loop arrival schedule of a client: arrival `i + 1` is scheduled an
+ * inter-arrival time after arrival `i`, regardless of when `i` was actually
+ * sent, such that a slow sender does not lower the offered load. Inter-arrival
+ * times are constant, exponentially distributed (Poisson arrivals) or replayed
+ * from a trace scaled to the current rate.
+ *
+ * Times are CLOCK_MONOTONIC nanoseconds. The schedule is owned by the sending
+ * thread of a client, except for `setRate` and `takeDrift` which may be called
+ * from any thread.
+ */
+class Pacer {
+ public:
+  enum class Process { Constant, Poisson, Replay };
+
+  /// `replayGapsNanos` must hold at least one non-zero gap with the Replay process
+  Pacer(Process process, std::vector<uint64_t> replayGapsNanos = {}, unsigned int seed = std::random_device{}())
+      : process(process), replayGaps(std::move(replayGapsNanos)), gen(seed), rate(0) {
+    if (!replayGaps.empty()) {
+      double total = 0;
+      for (uint64_t gap : replayGaps) total += gap;
+      replayMeanNanos = total / replayGaps.size();
+      // clients sharing a trace start at different offsets of it
+      replayIdx = gen() % replayGaps.size();
+    }
+  }
+
+  /**
+   * @return the inter-arrival times of `filename`, one in nanoseconds per line,
+   * or an empty vector if it cannot be read or they add up to 0
+   */
+  static std::vector<uint64_t> readReplayGaps(const std::string& filename) {
+    std::ifstream file(filename);
+    std::vector<uint64_t> gaps;
+    uint64_t gap, total = 0;
+    while (file >> gap) {
+      gaps.push_back(gap);
+      total += gap;
+    }
+    if (total == 0) gaps.clear();
+    return gaps;
+  }
+
+  /// sets the mean arrival rate in requests per second. 0 pauses the schedule
+  void setRate(double rps) { rate.store(rps); }
+
+  /// @return the current CLOCK_MONOTONIC time in nanoseconds
+  static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+  }
+
+  /**
+   * @return the scheduled time of the next arrival without consuming it, or 0
+   * if the schedule is paused
+   */
+  uint64_t peek() {
+    if (hasNext) return nextArrival;
+
+    double rps = rate.load();
+    if (rps <= 0) {
+      paused = true;
+      return 0;
+    }
+
+    // resuming: the arrivals of a paused schedule are not owed
+    if (paused) {
+      lastArrival = now();
+      paused = false;
+    }
+
+    nextArrival = lastArrival + sampleGap(rps);
+    hasNext = true;
+    return nextArrival;
+  }
+
+  /// @return the scheduled time of the next arrival, or 0 if the schedule is paused
+  uint64_t next() {
+    uint64_t arrival = peek();
+    if (arrival) {
+      lastArrival = arrival;
+      hasNext = false;
+    }
+    return arrival;
+  }
+
+  /**
+   * @brief sleeps until shortly before `deadline` with clock_nanosleep, then
+   * spins for the rest to not depend on timer slack and wake-up latency
+   *
+   * @return `false` if `stop` was set while waiting
+   */
+  bool waitUntil(uint64_t deadline, volatile bool& stop) {
+    uint64_t t;
+    while ((t = now()) + PACER_SPIN_NANOS < deadline) {
+      if (stop) return false;
+      uint64_t wakeup = std::min(deadline - PACER_SPIN_NANOS, t + PACER_MAX_SLEEP_NANOS);
+      struct timespec ts = {.tv_sec = (time_t)(wakeup / 1'000'000'000), .tv_nsec = (long)(wakeup % 1'000'000'000)};
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    }
+    while (now() < deadline)
+      if (stop) return false;
+    return !stop;
+  }
+
+  /// records that a send scheduled at `scheduled` left at `actual`
+  void recordSend(uint64_t scheduled, uint64_t actual) {
+    uint64_t drift = actual > scheduled ? actual - scheduled : 0;
+    driftSends.fetch_add(1);
+    driftTotalNanos.fetch_add(drift);
+
+    uint64_t max = driftMaxNanos.load();
+    while (drift > max && !driftMaxNanos.compare_exchange_weak(max, drift)) {
+    }
+  }
+
+  /**
+   * @return the drift of the sends since the last call, and resets it. A send
+   * recorded meanwhile may be split across two calls, but is never lost
+   */
+  DriftStats takeDrift() {
+    DriftStats ret;
+    ret.sends = driftSends.exchange(0);
+    ret.totalNanos = driftTotalNanos.exchange(0);
+    ret.maxNanos = driftMaxNanos.exchange(0);
+    return ret;
+  }
+
+ private:
+  Process process;
+  std::vector<uint64_t> replayGaps;
+  double replayMeanNanos = 0;
+  size_t replayIdx = 0;
+  std::mt19937 gen;
+  std::atomic<double> rate;
+
+  uint64_t lastArrival = 0;
+  uint64_t nextArrival = 0;
+  bool hasNext = false;
+  bool paused = true;
+
+  // see `DriftStats`, atomic as they are taken by another thread than the sender
+  std::atomic<uint64_t> driftSends = 0;
+  std::atomic<uint64_t> driftTotalNanos = 0;
+  std::atomic<uint64_t> driftMaxNanos = 0;
+
+  /// @return an inter-arrival time in nanoseconds at mean rate `rps`
+  uint64_t sampleGap(double rps) {
+    double meanNanos = 1e9 / rps;
+    switch (process) {
+      case Process::Poisson:
+        return std::exponential_distribution<double>(1.0 / meanNanos)(gen);
+      case Process::Replay: {
+        uint64_t gap = replayGaps[replayIdx];
+        replayIdx = (replayIdx + 1) % replayGaps.size();
+        return gap * (meanNanos / replayMeanNanos);
+      }
+      case Process::Constant:
+      default:
+        return meanNanos;
+    }
+  }
+};
+
+#endif
@@ -28,7 +28,7 @@ struct StatContents {
 
 struct MemoizedData {
   unsigned long cyclesCounted;  // How many cycles have already been counted (to avoid double-counting)
-  unsigned long prevProbe;      // When the PID was last probed. Measured in clock ticks since boot
+  double prevProbe;             // When the PID was last probed. Measured in clock ticks since boot
 };
 
 /**
@@ -45,6 +45,10 @@ class ProcParser {
   // Maps pid to some memoized data
   std::unordered_map<int, MemoizedData> memoizedDataMap;
 
+  // `/proc` is only searched again once a matching process could not be read,
+  // as the control loops query utilizations up to every 10ms
+  bool pidsStale = true;
+
   static bool fileExists(fs::path& targetFilePath) {
     return fs::exists(targetFilePath) && fs::is_regular_file(targetFilePath);
   }
@@ -123,10 +127,10 @@ class ProcParser {
   }
 
   /**
-   * @return the number of clock ticks since boot (accurate to the second) or
-   * `nullopt` on failure.
+   * @return the number of clock ticks since boot, with the 10ms precision of
+   * `/proc/uptime` rather than rounded to whole ticks, or `nullopt` on failure.
    */
-  std::optional<unsigned long> getUptimeTicks() {
+  std::optional<double> getUptimeTicks() {
     fs::path procPath = SLASH_PROC;
     fs::path uptimePath = procPath / std::string("uptime");
 
@@ -144,7 +148,7 @@ class ProcParser {
     double uptimeSeconds, idleSeconds;
     ss >> uptimeSeconds >> idleSeconds;
 
-    return (unsigned long)uptimeSeconds * sysconf(_SC_CLK_TCK);
+    return uptimeSeconds * sysconf(_SC_CLK_TCK);
   }
 
   // @return cpu utilization of a process with pid `pid` since the last probe as a fraction between [0, 1]
@@ -159,7 +163,7 @@ class ProcParser {
     if (itValue != memoizedDataMap.end())
       memoizedData = itValue->second;
     else {
-      MemoizedData defaultVal = {.cyclesCounted = 0, .prevProbe = statContents.starttime};
+      MemoizedData defaultVal = {.cyclesCounted = 0, .prevProbe = (double)statContents.starttime};
       memoizedDataMap.insert(std::make_pair(pid, defaultVal));
       memoizedData = defaultVal;
     }
@@ -168,14 +172,18 @@ class ProcParser {
     if (currUptime == std::nullopt) return std::nullopt;
 
     long activeTicksInWindow = statContents.stime - memoizedData.cyclesCounted;
-    long totalTicksInWindow = currUptime.value() - memoizedData.prevProbe;
+    double totalTicksInWindow = currUptime.value() - memoizedData.prevProbe;
 
     memoizedData.prevProbe = currUptime.value();
     memoizedData.cyclesCounted = statContents.stime;
     memoizedDataMap[pid] = memoizedData;
 
+    if (totalTicksInWindow <= 0) return 0.0;
+
+    // stime is counted in whole ticks, so it may exceed a short window by one
     if (activeTicksInWindow > totalTicksInWindow) {
-      std::cout << "\033[33mWarning: active ticks > total ticks! pid = " << pid << "\033[0m" << std::endl;
+      if (activeTicksInWindow > totalTicksInWindow + 1)
+        std::cout << "\033[33mWarning: active ticks > total ticks! pid = " << pid << "\033[0m" << std::endl;
       return 1.0;
     }
 
@@ -199,11 +207,17 @@ class ProcParser {
    */
   std::vector<double> getCpuUtilizationVec() {
     std::vector<double> output;
-    searchForMatchingPids();
+    if (pidsStale) {
+      searchForMatchingPids();
+      pidsStale = false;
+    }
     for (int pid : pidMatches) {
       auto utilization = computeCpuUtilization(pid);
-      if (utilization == std::nullopt) std::cerr << "Failed to compute utilization for pid=" << pid << std::endl;
-      output.push_back(utilization.value());
+      if (utilization == std::nullopt) {
+        std::cerr << "Failed to compute utilization for pid=" << pid << std::endl;
+        pidsStale = true;
+      }
+      output.push_back(utilization.value_or(0.0));
     }
     return output;
   }
@@ -214,8 +228,14 @@ class ProcParser {
    * Note: this resets memoized state when called - thus is should only be
    * called once per window.
    */
-  double computeAverageCpuUtilization() {
-    auto cpuUtilizations = getCpuUtilizationVec();
+  double computeAverageCpuUtilization() { return averageCpuUtilization(getCpuUtilizationVec()); }
+
+  /**
+   * @return the average of the non-zero utilizations in `cpuUtilizations`, as
+   * returned by `getCpuUtilizationVec`. Allows computing both the average and
+   * per-process utilizations in the same window.
+   */
+  static double averageCpuUtilization(const std::vector<double>& cpuUtilizations) {
     double avgUtilization = 0.0;
     int nonZeroUtilizationsCount = 0;
 
@@ -6,16 +6,38 @@
 #define PROGRAM_OPTS_H
 
 #include <string>
+#include <vector>
+
+#include "../common/packet.h"
+#include "../common/sched.h"
 
 #define POLICY_ROUNDROBIN "rr"
 #define POLICY_ROUNDROBIN_CORE_SEP "rrcs"
 #define POLICY_DYNAMIC_CORE_ALLOC "dca"
+#define POLICY_DYNAMIC_CORE_ALLOC_UTILIZATION "dcau"
+#define POLICY_JOIN_SHORTEST_QUEUE "jsq"
+#define POLICY_POWER_OF_TWO "p2c"
+#define POLICY_ADAPTIVE_CORE_SEP "acs"
+#define POLICY_TIERED "tiered"
+#define POLICY_FLOW_HASH "hash"
+#define POLICY_DEADLINE "edf"
 
 #define CLIENT_MODE_BIMODAL "bimodal"
 #define CLIENT_MODE_UNIMODAL "unimodal"
 #define CLIENT_MODE_DEBUG "debug"
 #define CLIENT_MODE_BURSTY "bursty"
 
+#define ARRIVALS_POISSON "poisson"
+#define ARRIVALS_CONSTANT "constant"
+#define ARRIVALS_REPLAY "replay"
+
+// shortest period of the server control loop, in ms
+#define MIN_CONTROL_PERIOD_MS 10
+
+// packets a cpumap queue holds by default, and at most as enforced by the kernel
+#define DEFAULT_CPUMAP_QSIZE (1 << 12)
+#define MAX_CPUMAP_QSIZE (1 << 14)
+
 #define REQUIRE_NON_EMPTY(s) \
   if (s.empty()) return false;
 
@@ -25,20 +47,72 @@
 #define REQUIRE_POSITIVE(i) \
   if (i < 0) return false;
 
+/**
+ * Tuning of the dynamic core allocation autoscalers. Scaling decisions are taken
+ * on the p99 queuing delay if a target is set, else on an EWMA-smoothed average
+ * queuing delay (dca), or on the cpu utilization of the core group (dcau), and
+ * are followed by a cooldown.
+ */
+struct DcaOptions {
+  double scaleUpDelayUs = 200.0;       // smoothed queuing delay above which a cpu is added
+  double scaleDownDelayUs = 50.0;      // smoothed queuing delay below which a cpu may be removed
+  double p99TargetUs = 0.0;            // p99 queuing delay dca scales towards. 0 scales on the mean instead
+  double p99Gain = 1.0;                // proportional gain of the p99 controller
+  double scaleUpUtilization = 0.5;     // core group busy fraction above which dcau adds a cpu
+  double scaleDownUtilization = 0.3;   // core group busy fraction below which a cpu may be removed
+  int cooldownWindows = 3;             // windows without scaling after a scaling action
+  double ewmaAlpha = 0.5;              // weight of the latest window in the smoothed queuing delay
+  bool flowHash = false;               // steer flows by consistent hashing over the group instead of round-robin
+
+  /// returns `true` iff the options are consistent, for dcau iff `scaleOnUtilization`
+  bool isValid(bool scaleOnUtilization) const {
+    REQUIRE_POSITIVE(scaleDownDelayUs);
+    REQUIRE_POSITIVE(scaleDownUtilization);
+    REQUIRE_POSITIVE(cooldownWindows);
+    REQUIRE_STRICTLY_POSITIVE(ewmaAlpha);
+    REQUIRE_POSITIVE(p99TargetUs);
+    REQUIRE_STRICTLY_POSITIVE(p99Gain);
+    if (scaleDownDelayUs >= scaleUpDelayUs) return false;
+    if (ewmaAlpha > 1.0) return false;
+    // dca only gates scale-downs on the utilization, and does not use `scaleUpUtilization`
+    if (scaleOnUtilization && (scaleUpUtilization > 1.0 || scaleDownUtilization >= scaleUpUtilization)) return false;
+    return true;
+  }
+};
+
 /**
  * Defines the set of program options
  */
 struct ProgramOptions {
   int port = 50'000;
   int duration = 60;
+  int periodMs = 1000;
+  int traceSampleRate = 0;
+  int spillThreshold = 0;
+  int stealThreshold = 0;
+  int stealMaxHops = 1;
+  int qsize = DEFAULT_CPUMAP_QSIZE;
+  int qsizeLong = -1;  // -1 uses `qsize`
+  int admissionDeadlineUs = 0;
+  bool admissionReply = false;
   int numCpus = -1;
   int numLongCpus = -1;
+  int numLatencyCpus = -1;
+  int tightDeadlineUs = 100;
   int numClients = 5;
+  int batchSize = 1;
+  std::vector<int> tierBounds;
+  std::vector<int> tierCpus;
+  std::vector<int> deadlinesUs;
+  std::vector<int> deadlineWeights;
+  DcaOptions dca;
   std::string mode;
   std::string serverPolicy;
   std::string ifname;
   std::string serverIP;
   std::string distribution;
+  std::string arrivals = ARRIVALS_POISSON;
+  std::string arrivalTrace;
 
  public:
   bool isServerBench() { return mode == "server"; }
@@ -65,12 +139,51 @@ struct ProgramOptions {
     REQUIRE_NON_EMPTY(ifname);
     REQUIRE_STRICTLY_POSITIVE(port);
     REQUIRE_STRICTLY_POSITIVE(numCpus);
+    // the least-loaded scans of jsq, edf, hash spilling and work stealing stop at MAX_SCHED_CPUS cpus
+    if (numCpus > MAX_SCHED_CPUS) return false;
     REQUIRE_STRICTLY_POSITIVE(duration);
+    if (periodMs < MIN_CONTROL_PERIOD_MS) return false;
+    REQUIRE_POSITIVE(traceSampleRate);
+    REQUIRE_POSITIVE(spillThreshold);
+    REQUIRE_POSITIVE(stealThreshold);
+    REQUIRE_STRICTLY_POSITIVE(stealMaxHops);
+    REQUIRE_STRICTLY_POSITIVE(qsize);
+    REQUIRE_POSITIVE(admissionDeadlineUs);
+    if (qsize > MAX_CPUMAP_QSIZE || qsizeLong == 0 || qsizeLong > MAX_CPUMAP_QSIZE) return false;
 
-    if (serverPolicy == POLICY_ROUNDROBIN_CORE_SEP) {
+    if (serverPolicy == POLICY_ROUNDROBIN_CORE_SEP || serverPolicy == POLICY_ADAPTIVE_CORE_SEP) {
       REQUIRE_STRICTLY_POSITIVE(numLongCpus);
     }
 
+    if (serverPolicy == POLICY_DEADLINE) {
+      REQUIRE_STRICTLY_POSITIVE(numLatencyCpus);
+      REQUIRE_STRICTLY_POSITIVE(tightDeadlineUs);
+      if (numLatencyCpus >= numCpus) return false;
+    }
+
+    if ((serverPolicy == POLICY_DYNAMIC_CORE_ALLOC || serverPolicy == POLICY_DYNAMIC_CORE_ALLOC_UTILIZATION) &&
+        !dca.isValid(serverPolicy == POLICY_DYNAMIC_CORE_ALLOC_UTILIZATION))
+      return false;
+
+    if (serverPolicy == POLICY_TIERED) {
+      if (tierCpus.empty() || tierCpus.size() > MAX_TIERS) return false;
+      if (tierBounds.size() + 1 != tierCpus.size()) return false;
+
+      int totalCpus = 0;
+      for (int cpus : tierCpus) {
+        REQUIRE_STRICTLY_POSITIVE(cpus);
+        if (cpus > MAX_SCHED_CPUS) return false;
+        totalCpus += cpus;
+      }
+      if (totalCpus != numCpus) return false;
+
+      // bounds must be strictly increasing
+      for (unsigned i = 0; i < tierBounds.size(); i++) {
+        REQUIRE_STRICTLY_POSITIVE(tierBounds[i]);
+        if (i > 0 && tierBounds[i] <= tierBounds[i - 1]) return false;
+      }
+    }
+
     return true;
   }
 
@@ -84,6 +197,19 @@ struct ProgramOptions {
     REQUIRE_POSITIVE(port);
     REQUIRE_STRICTLY_POSITIVE(duration);
     REQUIRE_STRICTLY_POSITIVE(numClients);
+    REQUIRE_STRICTLY_POSITIVE(batchSize);
+    if (batchSize > PACKET_MAX_REQUESTS) return false;
+    if (arrivals != ARRIVALS_POISSON && arrivals != ARRIVALS_CONSTANT && arrivals != ARRIVALS_REPLAY) return false;
+    if (arrivals == ARRIVALS_REPLAY) REQUIRE_NON_EMPTY(arrivalTrace);
+
+    if (deadlinesUs.size() != deadlineWeights.size()) return false;
+    double totalWeight = 0;
+    for (unsigned i = 0; i < deadlinesUs.size(); i++) {
+      REQUIRE_POSITIVE(deadlinesUs[i]);
+      REQUIRE_POSITIVE(deadlineWeights[i]);
+      totalWeight += deadlineWeights[i];
+    }
+    if (!deadlinesUs.empty() && totalWeight == 0) return false;
 
     return true;
   }
@@ -0,0 +1,95 @@
+#ifndef SCHED_TRACER
+#define SCHED_TRACER
+
+#include <bpf/libbpf.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../common/sched.h"
+
+#define SCHED_TRACE_FILEPATH "server_results/sched_trace.bin"
+#define SCHED_TRACE_POLL_TIMEOUT_MS 100
+
+/**
+ * @brief consumes the sampled scheduling decisions of the `sched_events` ring
+ * buffer on a dedicated thread, and appends them as raw `struct sched_event`
+ * records to a binary trace file.
+ */
+class SchedTracer {
+ private:
+  struct ring_buffer *rb = nullptr;
+  FILE *file = nullptr;
+  std::thread consumer;
+  std::atomic<bool> running = false;
+  unsigned long long numEvents = 0;
+
+  static int handleEvent(void *ctx, void *data, size_t size) {
+    auto *tracer = static_cast<SchedTracer *>(ctx);
+    if (size < sizeof(struct sched_event)) return 0;
+
+    fwrite(data, sizeof(struct sched_event), 1, tracer->file);
+    tracer->numEvents++;
+    return 0;
+  }
+
+  void consume() {
+    while (running.load(std::memory_order_relaxed)) {
+      int err = ring_buffer__poll(rb, SCHED_TRACE_POLL_TIMEOUT_MS);
+      if (err < 0 && err != -EINTR) {
+        std::cerr << "ring_buffer__poll failed: " << strerror(-err) << std::endl;
+        break;
+      }
+    }
+    // drain what was submitted before stopping
+    ring_buffer__poll(rb, 0);
+  }
+
+ public:
+  SchedTracer() = default;
+  SchedTracer(const SchedTracer&) = delete;
+  SchedTracer& operator=(const SchedTracer&) = delete;
+
+  ~SchedTracer() { stop(); }
+
+  /**
+   * Starts consuming the ring buffer `ringFd` into the file at `path`
+   * @return 0 on success, -1 on failure
+   */
+  int start(int ringFd, const std::string& path) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+      std::cerr << "Unable to open " << path << ": " << strerror(errno) << std::endl;
+      return -1;
+    }
+
+    rb = ring_buffer__new(ringFd, handleEvent, this, nullptr);
+    if (!rb) {
+      std::cerr << "Unable to create ring buffer: " << strerror(errno) << std::endl;
+      fclose(file);
+      file = nullptr;
+      return -1;
+    }
+
+    running = true;
+    consumer = std::thread(&SchedTracer::consume, this);
+    return 0;
+  }
+
+  void stop() {
+    running = false;
+    if (consumer.joinable()) consumer.join();
+    if (rb) ring_buffer__free(rb);
+    if (file) fclose(file);
+    rb = nullptr;
+    file = nullptr;
+  }
+
+  unsigned long long getNumEvents() const { return numEvents; }
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef _SEQUENCE_TRACKER_H
+#define _SEQUENCE_TRACKER_H
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#define DEFAULT_SEQUENCE_WINDOW (1 << 16)       // request ids
+#define DEFAULT_LOSS_TIMEOUT_NANOS 100'000'000  // 100ms
+#define SEQUENCE_CHECKPOINTS 8                  // send times remembered per loss timeout
+
+/**
+ * @brief delivery anomalies of the requests of a client, as detected from the
+ * ids the server echoes back
+ */
+struct DeliveryCounts {
+  uint64_t lost = 0;        // not received within the loss timeout or the window
+  uint64_t reordered = 0;   // received after a higher id, before being counted as lost
+  uint64_t duplicates = 0;  // received more than once, before being counted as lost
+  uint64_t late = 0;        // received after being counted as lost or received
+
+  DeliveryCounts& operator+=(const DeliveryCounts& other) {
+    lost += other.lost;
+    reordered += other.reordered;
+    duplicates += other.duplicates;
+    late += other.late;
+    return *this;
+  }
+};
+
+/**
+ * Tracks the ids of received requests in a sliding bitmap of at most
+ * `windowSize` ids below the highest one received. Ids below the window are
+ * settled: counted as lost unless they were received. An id is settled once it
+ * leaves the window, or once a higher id sent more than `lossTimeoutNanos` ago
+ * has been received, such that loss is reported about a timeout after it
+ * happened regardless of the rate. A settled id that is received is counted as
+ * late. `flush` settles all ids when the client stops.
+ *
+ * Ids are expected to start at 0 and increase by one per sent request, in the
+ * order of their send times, and may wrap around.
+ *
+ * `record` and `flush` are meant to be called by the receiving thread of a
+ * client only, while `takeCounts` may be called from any thread.
+ */
+class SequenceTracker {
+ public:
+  SequenceTracker(uint64_t windowSize = DEFAULT_SEQUENCE_WINDOW,
+                  uint64_t lossTimeoutNanos = DEFAULT_LOSS_TIMEOUT_NANOS)
+      : windowSize(windowSize), lossTimeoutNanos(lossTimeoutNanos), bitmap((windowSize + 63) / 64, 0) {}
+
+  /**
+   * records the reception at `now` of request `id`, intended to be sent at
+   * `sentAt`. Both are nanoseconds on the same clock
+   */
+  void record(uint32_t id, uint64_t sentAt, uint64_t now) {
+    // extends the 32-bit id to the position closest to `head`
+    int64_t delta = (int32_t)(id - (uint32_t)head);
+    if (delta < 0 && (uint64_t)-delta > head) {
+      late.fetch_add(1);
+      return;
+    }
+    uint64_t pos = head + delta;
+
+    if (pos < settled) {
+      late.fetch_add(1);
+    } else if (pos >= head) {
+      if (pos + 1 > windowSize) settle(pos + 1 - windowSize);
+      head = pos + 1;
+      setBit(pos);
+      addCheckpoint(pos, sentAt);
+    } else if (testBit(pos)) {
+      duplicates.fetch_add(1);
+    } else {
+      setBit(pos);
+      reordered.fetch_add(1);
+    }
+
+    // ids below a received id sent long enough ago were sent even earlier
+    while (!checkpoints.empty() && checkpoints.front().second + lossTimeoutNanos < now) {
+      settle(checkpoints.front().first);
+      checkpoints.pop_front();
+    }
+  }
+
+  /// counts the ids that were sent but not received yet as lost
+  void flush() {
+    settle(head);
+    checkpoints.clear();
+  }
+
+  /// @return the counts since the last call, and resets them
+  DeliveryCounts takeCounts() {
+    DeliveryCounts ret;
+    ret.lost = lost.exchange(0);
+    ret.reordered = reordered.exchange(0);
+    ret.duplicates = duplicates.exchange(0);
+    ret.late = late.exchange(0);
+    return ret;
+  }
+
+ private:
+  uint64_t windowSize;
+  uint64_t lossTimeoutNanos;
+  std::vector<uint64_t> bitmap;  // bits of the received ids in [settled, head)
+  uint64_t head = 0;             // one past the highest id received
+  uint64_t settled = 0;          // ids below are accounted for, and their bits cleared
+  // received ids with their send times, spaced by a fraction of the loss timeout
+  std::deque<std::pair<uint64_t, uint64_t>> checkpoints;
+
+  // see `DeliveryCounts`, atomic as they are taken by another thread than the receiver
+  std::atomic<uint64_t> lost = 0;
+  std::atomic<uint64_t> reordered = 0;
+  std::atomic<uint64_t> duplicates = 0;
+  std::atomic<uint64_t> late = 0;
+
+  bool testBit(uint64_t pos) { return bitmap[(pos % windowSize) / 64] & (1ULL << (pos % windowSize % 64)); }
+  void setBit(uint64_t pos) { bitmap[(pos % windowSize) / 64] |= 1ULL << (pos % windowSize % 64); }
+  void clearBit(uint64_t pos) { bitmap[(pos % windowSize) / 64] &= ~(1ULL << (pos % windowSize % 64)); }
+
+  /**
+   * Settles the ids below `upTo`: those not received are counted as lost, and
+   * the slots of the received ones are cleared for the ids entering the window.
+   */
+  void settle(uint64_t upTo) {
+    if (upTo <= settled) return;
+
+    // ids at or above `head` were never received. Skip them at once on large jumps
+    uint64_t scanEnd = std::min(upTo, head);
+    uint64_t missing = upTo - scanEnd;
+    for (uint64_t pos = settled; pos < scanEnd; pos++) {
+      if (!testBit(pos)) missing++;
+      clearBit(pos);
+    }
+    if (missing) lost.fetch_add(missing);
+
+    settled = upTo;
+  }
+
+  void addCheckpoint(uint64_t pos, uint64_t sentAt) {
+    if (!checkpoints.empty() && sentAt < checkpoints.back().second + lossTimeoutNanos / SEQUENCE_CHECKPOINTS) return;
+    checkpoints.emplace_back(pos, sentAt);
+  }
+};
+
+#endif
@@ -10,13 +10,22 @@
 
 #include <ServerBenchmark.hpp>
 #include <Skeleton.cpp>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <ostream>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "../common/histogram.h"
+#include "../common/sched.h"
+#include "ControlLoop.cpp"
 #include "ProcParser.cpp"
+#include "SchedTracer.cpp"
+#include "StatsCollector.cpp"
 
 #define GET_FD(fd, map_name)                   \
   fd = bpf_map__fd(skel.get()->maps.map_name); \
@@ -26,16 +35,91 @@
   if (bpf_map__set_max_entries(skel.get()->maps.map_name, value) < 0) return -1;
 
 #define CPUMAP_QUERY "cpumap"
-#define BUFFER_SIZE 1024
 #define CPU_ADDED_TIMESTAMPS_FILEPATH "server_results/cpu_added_timestamps.txt"
+#define QD_PERCENTILES_FILEPATH "server_results/qd_percentiles.csv"
+#define QUEUE_DEPTHS_FILEPATH "server_results/queue_depths.csv"
 
-int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration) {
+// applied to every skeleton loaded by openAndLoadSkeleton
+static struct steal_config stealConfig = {.queue_threshold = 0, .max_hops = 1};
+
+void configureWorkStealing(int queueThreshold, int maxHops) {
+  stealConfig.queue_threshold = queueThreshold;
+  stealConfig.max_hops = maxHops;
+}
+
+// applied to every skeleton loaded by openAndLoadSkeleton
+static struct admission_config admissionConfig = {};
+
+void configureAdmissionControl(int deadlineUs, bool reply) {
+  admissionConfig.deadline_us = deadlineUs;
+  admissionConfig.reply = reply;
+}
+
+// cpumap queue sizes of the cpus of the short/default and long groups
+static __u32 cpumapQsize = DEFAULT_CPUMAP_QSIZE;
+static __u32 cpumapQsizeLong = DEFAULT_CPUMAP_QSIZE;
+
+void configureCpumapQueues(int qsize, int qsizeLong) {
+  cpumapQsize = qsize;
+  cpumapQsizeLong = qsizeLong;
+}
+
+/// @return the cpumap entry of a cpu running `cpuProgFd`, in the long group iff `longGroup`
+static struct bpf_cpumap_val cpumapEntry(int cpuProgFd, bool longGroup) {
+  struct bpf_cpumap_val val = {};
+  val.qsize = longGroup ? cpumapQsizeLong : cpumapQsize;
+  val.bpf_prog.fd = cpuProgFd;
+  return val;
+}
+
+/// @return the number of rx queues of `ifname`, or of possible cpus if unknown
+static int countRxQueues(const std::string& ifname) {
+  int possibleCpus = libbpf_num_possible_cpus();
+  int nrRx = 0;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator("/sys/class/net/" + ifname + "/queues", ec)) {
+    if (entry.path().filename().string().rfind("rx-", 0) == 0) nrRx++;
+  }
+  return nrRx > 0 && nrRx < possibleCpus ? nrRx : possibleCpus;
+}
+
+/**
+ * Seeds the round-robin cursor of entry `key` of the per-cpu array `iterFd`,
+ * scanning a group of `groupSize` cpus, such that the rx queues of `ifname`
+ * start at offsets spread evenly over the group. Rx queue i is assumed to be
+ * served by cpu i, so each rx cpu starts at its rank among the rx queues scaled
+ * by `groupSize / nrRx`, rounded.
+ * @return 0 on success, -1 on failure
+ */
+static int seedRoundRobinCursor(int iterFd, __u32 key, __u32 groupSize, const std::string& ifname) {
+  if (groupSize == 0) return 0;
+  __u64 nrRx = countRxQueues(ifname);
+
+  // per-cpu values are laid out in 8-byte slots
+  std::vector<__u64> cursors(libbpf_num_possible_cpus());
+  for (size_t rxCpu = 0; rxCpu < cursors.size(); rxCpu++) {
+    __u64 rank = rxCpu % nrRx;
+    cursors[rxCpu] = (rank * groupSize + nrRx / 2) / nrRx % groupSize;
+  }
+
+  if (bpf_map_update_elem(iterFd, &key, cursors.data(), 0)) {
+    std::cerr << "Unable to seed round-robin cursor " << key << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Opens the skeleton, sizes the maps indexed by cpu to the number of possible
+ * cpus, loads it and configures work stealing and admission control.
+ * @return 0 on success, -1 on failure
+ */
+static int openAndLoadSkeleton(Skeleton<bpfnic>& skel) {
   int err;
-  int portFd, availFd, mapFd, iterFd, countFd, devmapFd, txCtrFd, rxCtrFd, totalSrvTimeFd;
   int maxCpus;
+  int stealFd, admissionFd;
   __u32 key0 = 0;
-  auto skel = Skeleton<bpfnic>();
-  auto procParser = ProcParser(CPUMAP_QUERY);
+  struct bpf_link *dropsLink;
 
   struct bpf_object_open_opts opts;
   memset(&opts, 0, sizeof(struct bpf_object_open_opts));
@@ -53,6 +137,11 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
   SET_MAX_ENTRIES(cpus_available, maxCpus);
   SET_MAX_ENTRIES(cpus_available_long_reqs, maxCpus);
   SET_MAX_ENTRIES(cpus_available_short_reqs, maxCpus);
+  SET_MAX_ENTRIES(cpu_inflight, maxCpus);
+  SET_MAX_ENTRIES(cpu_outstanding_work, maxCpus);
+  SET_MAX_ENTRIES(cpu_stats, maxCpus);
+  SET_MAX_ENTRIES(qd_hist, maxCpus);
+  SET_MAX_ENTRIES(rx_packet_ctr, maxCpus);
 
   err = skel.load();
   if (err) {
@@ -62,6 +151,202 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
     std::cout << "successfully loaded skel" << std::endl;
   }
 
+  GET_FD(stealFd, steal_cfg);
+  if (bpf_map_update_elem(stealFd, &key0, &stealConfig, 0)) return -1;
+
+  GET_FD(admissionFd, admission_cfg);
+  if (bpf_map_update_elem(admissionFd, &key0, &admissionConfig, 0)) return -1;
+
+  // accounts cpumap queue drops, for as long as the process lives
+  dropsLink = bpf_program__attach(skel.get()->progs.bpfnic_cpumap_enqueue);
+  if (!dropsLink) {
+    std::cerr << "Unable to attach to xdp_cpumap_enqueue: " << strerror(errno) << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Sets the sampling rate of scheduling decisions to one in `sampleRate`, and
+ * starts consuming the samples into SCHED_TRACE_FILEPATH with `tracer` unless
+ * sampling is disabled (`sampleRate` = 0).
+ * @return 0 on success, -1 on failure
+ */
+static int startSchedTrace(Skeleton<bpfnic>& skel, __u32 sampleRate, SchedTracer& tracer) {
+  int rateFd, eventsFd;
+  __u32 key0 = 0;
+
+  GET_FD(rateFd, trace_sample_rate);
+  GET_FD(eventsFd, sched_events);
+
+  if (bpf_map_update_elem(rateFd, &key0, &sampleRate, 0)) return -1;
+  if (sampleRate == 0) return 0;
+
+  std::cout << "Sampling 1 in " << sampleRate << " scheduling decisions to " << SCHED_TRACE_FILEPATH << std::endl;
+  return tracer.start(eventsFd, SCHED_TRACE_FILEPATH);
+}
+
+/**
+ * Maps the statistics of the loaded skeleton into `stats`
+ * @return 0 on success, -1 on failure
+ */
+static int initStatsCollector(Skeleton<bpfnic>& skel, StatsCollector& stats) {
+  int cpuStatsFd, qdHistFd, rxCtrFd;
+
+  GET_FD(cpuStatsFd, cpu_stats);
+  GET_FD(qdHistFd, qd_hist);
+  GET_FD(rxCtrFd, rx_packet_ctr);
+
+  return stats.init(cpuStatsFd, qdHistFd, rxCtrFd, bpf_map__max_entries(skel.get()->maps.cpu_stats));
+}
+
+/**
+ * Reads the first `values.size()` entries of the array map `fd`, keyed by
+ * cpu, in a single syscall
+ * @return 0 on success, -1 on failure
+ */
+static int lookupPerCpuEntries(int fd, std::vector<__u64>& values) {
+  std::vector<__u32> keys(values.size());
+  __u32 count = values.size();
+  __u32 outBatch;
+
+  // -ENOENT only signals that the whole map has been read
+  int err = bpf_map_lookup_batch(fd, nullptr, &outBatch, keys.data(), values.data(), &count, nullptr);
+  return err && err != -ENOENT ? -1 : 0;
+}
+
+static std::ofstream openQueueDepthsFile() {
+  std::ofstream file(QUEUE_DEPTHS_FILEPATH);
+  file << "window,cpu,inflight,outstanding_work_us,enqueue_drops" << std::endl;
+  return file;
+}
+
+/**
+ * Displays and appends to `file` the requests and work outstanding on every cpu
+ * in `cpus` at the end of the last window, i.e. the depth of their cpumap queue,
+ * along with the requests the queue dropped over the window.
+ */
+static void reportQueueDepths(int inflightFd, int workFd, const StatsCollector& stats, const std::vector<int>& cpus,
+                              int window, std::ofstream& file) {
+  auto& counters = stats.getWindow();
+  std::vector<__u64> inflights(counters.size());
+  std::vector<__u64> works(counters.size());
+
+  if (lookupPerCpuEntries(inflightFd, inflights)) exit(1);
+  if (lookupPerCpuEntries(workFd, works)) exit(1);
+
+  std::cout << "\tOutstanding requests\n";
+  for (int cpu : cpus) {
+    if ((size_t)cpu >= counters.size()) continue;
+    std::cout << "\t\tcpu_" << cpu << " = " << inflights[cpu] << " reqs, " << works[cpu] << " μs of work, "
+              << counters[cpu].enqueue_drops << " dropped\n";
+    file << window << "," << cpu << "," << inflights[cpu] << "," << works[cpu] << "," << counters[cpu].enqueue_drops
+         << "\n";
+  }
+  file.flush();
+}
+
+/// displays the average queuing delay of every cpu that processed requests over the last window
+static void printAvgQueuingDelays(const StatsCollector& stats) {
+  auto& window = stats.getWindow();
+
+  std::cout << "\tAvg. queuing delays\n";
+  for (size_t cpu = 0; cpu < window.size(); cpu++) {
+    if (window[cpu].srv_time > 0 && window[cpu].tx_packets > 0) {
+      std::cout << "\t\tcpu_" << cpu << " = " << ((double)window[cpu].srv_time / window[cpu].tx_packets) / 1000.0
+                << " μs\n";
+    }
+  }
+}
+
+/// queuing delay percentiles over a window, in microseconds
+struct QdPercentiles {
+  __u64 count = 0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+  double p999 = 0.0;
+};
+
+/**
+ * @return the value below which a fraction `q` of the samples recorded in
+ * `buckets` lie, taken as the midpoint of the bucket it falls in. 0 if empty
+ */
+static double histPercentile(const unsigned long long *buckets, __u64 count, double q) {
+  if (count == 0) return 0.0;
+
+  __u64 rank = std::max<__u64>(1, (__u64)std::ceil(q * count));
+  __u64 seen = 0;
+  for (__u32 i = 0; i < HIST_NUM_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) return hist_bucket_lower(i) + (hist_bucket_width(i) - 1) / 2.0;
+  }
+  return hist_bucket_lower(HIST_NUM_BUCKETS - 1);
+}
+
+static QdPercentiles computeQdPercentiles(const unsigned long long *buckets) {
+  QdPercentiles res;
+  for (__u32 i = 0; i < HIST_NUM_BUCKETS; i++) res.count += buckets[i];
+
+  res.p50 = histPercentile(buckets, res.count, 0.50) / 1000.0;
+  res.p99 = histPercentile(buckets, res.count, 0.99) / 1000.0;
+  res.p999 = histPercentile(buckets, res.count, 0.999) / 1000.0;
+  return res;
+}
+
+/// @return a csv for the per-window queuing delay percentiles, with its header written
+static std::ofstream openQdPercentilesFile() {
+  std::ofstream file(QD_PERCENTILES_FILEPATH);
+  file << "window,cpu,count,p50_us,p99_us,p999_us" << std::endl;
+  return file;
+}
+
+/**
+ * Displays and appends to `file` the p50/p99/p99.9 of the per-cpu queuing
+ * delay histograms of the last window, per cpu and in aggregate (`cpu` = all).
+ * @return the aggregate percentiles
+ */
+static QdPercentiles reportQdPercentiles(const StatsCollector& stats, int window, std::ofstream& file) {
+  auto& hists = stats.getWindowHists();
+  struct latency_hist aggregate = {};
+
+  std::cout << "\tQueuing delay percentiles (p50 / p99 / p99.9)\n";
+  for (__u32 cpu = 0; cpu < hists.size(); cpu++) {
+    for (__u32 i = 0; i < HIST_NUM_BUCKETS; i++) aggregate.buckets[i] += hists[cpu].buckets[i];
+
+    QdPercentiles res = computeQdPercentiles(hists[cpu].buckets);
+    if (res.count == 0) continue;
+
+    std::cout << "\t\tcpu_" << cpu << " = " << res.p50 << " / " << res.p99 << " / " << res.p999 << " μs\n";
+    file << window << "," << cpu << "," << res.count << "," << res.p50 << "," << res.p99 << "," << res.p999 << "\n";
+  }
+
+  QdPercentiles total = computeQdPercentiles(aggregate.buckets);
+  std::cout << "\t\tall = " << total.p50 << " / " << total.p99 << " / " << total.p999 << " μs\n";
+  file << window << ",all," << total.count << "," << total.p50 << "," << total.p99 << "," << total.p999 << std::endl;
+
+  return total;
+}
+
+/**
+ * Loads the XDP program `progName`, which schedules packets over the single
+ * core group `cpus`, onto `ifname` and displays statistics every second for
+ * `duration` seconds. `spillThreshold` only applies to the flow-hash program.
+ */
+static int redirectProgSingleGroup(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration,
+                                   int periodMs, int traceSampleRate, const char *progName,
+                                   __u32 spillThreshold = 0) {
+  int err;
+  int portFd, availFd, mapFd, iterFd, countFd, devmapFd, inflightFd, workFd, spillFd;
+  __u32 key0 = 0;
+  auto skel = Skeleton<bpfnic>();
+  auto procParser = ProcParser(CPUMAP_QUERY);
+
+  if (openAndLoadSkeleton(skel)) return -1;
+
+  SchedTracer tracer;
+  if (startSchedTrace(skel, traceSampleRate, tracer)) return -1;
+
   /* initialize the file descriptors */
   GET_FD(portFd, port_num);
   GET_FD(mapFd, cpu_map);
@@ -69,17 +354,15 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
   GET_FD(availFd, cpus_available);
   GET_FD(iterFd, cpu_iter);
   GET_FD(devmapFd, devmap);
-  GET_FD(txCtrFd, tx_packet_ctr);
-  GET_FD(rxCtrFd, rx_packet_ctr);
-  GET_FD(totalSrvTimeFd, total_srv_time);
+  GET_FD(inflightFd, cpu_inflight);
+  GET_FD(workFd, cpu_outstanding_work);
+  GET_FD(spillFd, hash_spill_threshold);
 
   __u32 cpusSize = cpus.size();
+  if (seedRoundRobinCursor(iterFd, key0, cpusSize, ifname)) return -1;
 
   int cpuProgFd = bpf_program__fd(skel.get()->progs.bpfnic_benchmark_cpu_func);
-
-  struct bpf_cpumap_val *cpumapVal = (struct bpf_cpumap_val *)malloc(sizeof(struct bpf_cpumap_val));
-  cpumapVal->qsize = (1 << 12);  // big queue
-  cpumapVal->bpf_prog.fd = cpuProgFd;
+  struct bpf_cpumap_val cpumapVal = cpumapEntry(cpuProgFd, false);
 
   // update cpumap with bpf programs
   for (__u32 i = 0; i < (__u32)cpusSize; i++) {
@@ -89,7 +372,7 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
       exit(1);
     }
 
-    if ((err = bpf_map_update_elem(mapFd, &currCpu, cpumapVal, 0))) {
+    if ((err = bpf_map_update_elem(mapFd, &currCpu, &cpumapVal, 0))) {
       std::cout << "Failed to create cpumap entry " << i << ": " << strerror(errno) << std::endl;
       exit(1);
     }
@@ -97,6 +380,7 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
 
   err = bpf_map_update_elem(portFd, &key0, &port, 0);
   bpf_map_update_elem(countFd, &key0, &cpusSize, 0);
+  bpf_map_update_elem(spillFd, &key0, &spillThreshold, 0);
 
   int ifindex = if_nametoindex(ifname.c_str());
   if (!ifindex) {
@@ -108,49 +392,43 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
   bpf_map_update_elem(devmapFd, &key0, &devmapEntry, 0);
 
   // attach xdp program
-  auto link = bpf_program__attach_xdp(skel.get()->progs.bpf_redirect_roundrobin, ifindex);
+  struct bpf_program *prog = bpf_object__find_program_by_name(skel.get()->obj, progName);
+  if (!prog) {
+    std::cerr << "Unable to find program " << progName << std::endl;
+    return -1;
+  }
+  auto link = bpf_program__attach_xdp(prog, ifindex);
   if (!link) exit(1);
 
   std::cout << "Program loaded on " << ifname << "; " << ifindex << std::endl;
 
-  __u64 txValues[BUFFER_SIZE] = {0};
-  __u64 srvTimes[BUFFER_SIZE] = {0};
-  __u64 rxValue = 0;
-  bpf_map_update_elem(txCtrFd, &key0, txValues, 0);
-  bpf_map_update_elem(totalSrvTimeFd, &key0, srvTimes, 0);
-  bpf_map_update_elem(rxCtrFd, &key0, &rxValue, 0);
+  StatsCollector stats;
+  if (initStatsCollector(skel, stats)) return -1;
+
+  std::ofstream qdPercentilesFile = openQdPercentilesFile();
+  std::ofstream queueDepthsFile = openQueueDepthsFile();
+
+  ControlLoop controlLoop(periodMs);
+  if (!controlLoop.isValid()) return -1;
+  int numWindows = controlLoop.windowsIn(duration);
 
   /* MAIN LOOP */
-  for (int time = 0; time < duration; time++) {
+  for (int time = 0; time < numWindows;) {
     /* book-keeping */
-    __u64 totalTxPackets = 0;
-    if (bpf_map_lookup_elem(txCtrFd, &key0, txValues)) exit(1);
-    if (bpf_map_lookup_elem(totalSrvTimeFd, &key0, srvTimes)) exit(1);
-    if (bpf_map_lookup_elem(rxCtrFd, &key0, &rxValue)) exit(1);
+    stats.collect();
 
     /* DISPLAY */
-    system("clear");
-    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << duration << "\n";
-    std::cout << "\tAvg. queuing delays\n";
-
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-      totalTxPackets += txValues[i];
-
-      if (srvTimes[i] > 0 && txValues[i] > 0) {
-        std::cout << "\t\tcpu_" << i << " = " << ((double)srvTimes[i] / txValues[i]) / 1000.0 << " μs\n";
-      }
-    }
+    ControlLoop::redrawScreen();
+    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << numWindows << " ("
+              << controlLoop.getMissedWindows() << " missed, " << periodMs << " ms windows)\n";
 
-    // clear arrays - state is kept per-window
-    std::fill(std::begin(srvTimes), std::end(srvTimes), 0);
-    std::fill(std::begin(txValues), std::end(txValues), 0);
+    printAvgQueuingDelays(stats);
+    reportQdPercentiles(stats, time, qdPercentilesFile);
 
-    __u64 zero = 0;
-    bpf_map_update_elem(txCtrFd, &key0, txValues, 0);
-    bpf_map_update_elem(totalSrvTimeFd, &key0, srvTimes, 0);
-    bpf_map_update_elem(rxCtrFd, &key0, &zero, 0);
+    std::cout << "\n\treceived " << stats.getWindowRx() << " |  sent " << stats.getWindowTx() << " |  shed "
+              << stats.getWindowShed() << " |  stolen " << stats.getWindowStolen() << "\n";
 
-    std::cout << "\n\treceived " << rxValue << " |  sent " << totalTxPackets << "\n";
+    reportQueueDepths(inflightFd, workFd, stats, cpus, time, queueDepthsFile);
 
     auto cpuUtilizations = procParser.getCpuUtilizationVec();
 
@@ -160,46 +438,94 @@ int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 po
                 << "% \n";
     }
     std::cout << std::endl;  // flush stdout
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    int elapsedWindows = controlLoop.waitForNextWindow();
+    if (elapsedWindows < 0) exit(1);
+    time += elapsedWindows;
   }
 
   return 0;
 }
 
-int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector<int>& cpusLong, std::string& ifname,
-                                        __u16 port, int duration) {
-  int err;
-  int portFd, availShortFd, availLongFd, mapFd, iterFd, countFd, devmapFd, txCtrFd, rxCtrFd, totalSrvTimeFd;
-  int numCpus;
+int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                           int traceSampleRate) {
+  return redirectProgSingleGroup(cpus, ifname, port, duration, periodMs, traceSampleRate, "bpf_redirect_roundrobin");
+}
+
+int redirectProgJoinShortestQueue(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                                  int traceSampleRate) {
+  return redirectProgSingleGroup(cpus, ifname, port, duration, periodMs, traceSampleRate, "bpf_redirect_jsq");
+}
+
+int redirectProgPowerOfTwo(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                           int traceSampleRate) {
+  return redirectProgSingleGroup(cpus, ifname, port, duration, periodMs, traceSampleRate, "bpf_redirect_p2c");
+}
+
+int redirectProgFlowHash(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                         int traceSampleRate, int spillThreshold) {
+  return redirectProgSingleGroup(cpus, ifname, port, duration, periodMs, traceSampleRate, "bpf_redirect_hash",
+                                 spillThreshold);
+}
+
+#define SPLIT_HYSTERESIS 0.25  // in cpus, on top of rounding, before the split is changed
+
+/**
+ * @return the number of cpus the long group should hold so that the split of
+ * `numCpus` between groups follows the ratio of work performed by each group,
+ * or `currLongSize` if the deviation is within hysteresis. Always leaves at
+ * least one cpu in each group.
+ */
+static __u32 targetLongGroupSize(__u64 shortWork, __u64 longWork, __u32 numCpus, __u32 currLongSize) {
+  if (shortWork + longWork == 0 || numCpus < 2) return currLongSize;
+
+  double idealLongSize = (double)numCpus * (double)longWork / (double)(shortWork + longWork);
+  if (std::abs(idealLongSize - (double)currLongSize) <= 0.5 + SPLIT_HYSTERESIS) return currLongSize;
+
+  __u32 target = (__u32)std::lround(idealLongSize);
+  return std::clamp(target, 1u, numCpus - 1);
+}
+
+/**
+ * Moves the last cpu of the group `from` to the end of the group `to`, where
+ * `fromKey` and `toKey` are the keys of their sizes in the map `countFd`.
+ *
+ * `from` is shrunk first, and the cpu is written into `toAvailFd` before `to`
+ * is grown, such that the XDP program only ever sees valid group entries.
+ */
+static void moveCpuBetweenGroups(std::vector<int>& from, __u32 fromKey, std::vector<int>& to, __u32 toKey,
+                                 int toAvailFd, int countFd) {
+  __u32 cpu = from.back();
+  __u32 fromSize = from.size() - 1;
+  __u32 toIdx = to.size();
+  __u32 toSize = to.size() + 1;
+
+  if (bpf_map_update_elem(countFd, &fromKey, &fromSize, 0)) exit(1);
+  if (bpf_map_update_elem(toAvailFd, &toIdx, &cpu, 0)) exit(1);
+  if (bpf_map_update_elem(countFd, &toKey, &toSize, 0)) exit(1);
+
+  from.pop_back();
+  to.push_back(cpu);
+}
+
+/**
+ * Loads the XDP program `progName`, which schedules packets over the two core
+ * groups `cpusShort` and `cpusLong`, onto `ifname` and displays statistics every
+ * window for `duration` seconds. `tightDeadlineUs` only applies to the
+ * deadline-aware program.
+ */
+static int redirectProgCoreSeparatedImpl(std::vector<int>& cpusShort, std::vector<int>& cpusLong, std::string& ifname,
+                                         __u16 port, int duration, int periodMs, int traceSampleRate,
+                                         bool adaptiveSplit, const char *progName, __u32 tightDeadlineUs) {
+  int portFd, availShortFd, availLongFd, mapFd, iterFd, countFd, devmapFd, inflightFd, workFd, tightDeadlineFd;
   __u32 key0 = 0;
   __u32 key1 = 1;
   auto skel = Skeleton<bpfnic>();
   auto procParser = ProcParser("cpumap");
 
-  struct bpf_object_open_opts opts;
-  memset(&opts, 0, sizeof(struct bpf_object_open_opts));
-  opts.sz = sizeof(struct bpf_object_open_opts);
-  err = skel.open(&opts);
-  if (err) {
-    std::cout << "Unable to open skel: " << strerror(err) << std::endl;
-    return -1;
-  } else {
-    std::cout << "successfully opened skel" << std::endl;
-  }
+  if (openAndLoadSkeleton(skel)) return -1;
 
-  numCpus = libbpf_num_possible_cpus();
-  SET_MAX_ENTRIES(cpu_map, numCpus);
-  SET_MAX_ENTRIES(cpus_available, numCpus);
-  SET_MAX_ENTRIES(cpus_available_long_reqs, numCpus);
-  SET_MAX_ENTRIES(cpus_available_short_reqs, numCpus);
-
-  err = skel.load();
-  if (err) {
-    std::cout << "err load: " << err << std::endl;
-    return -1;
-  } else {
-    std::cout << "successfully loaded skel" << std::endl;
-  }
+  SchedTracer tracer;
+  if (startSchedTrace(skel, traceSampleRate, tracer)) return -1;
 
   GET_FD(portFd, port_num);
   GET_FD(mapFd, cpu_map);
@@ -208,9 +534,15 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
   GET_FD(availLongFd, cpus_available_long_reqs);
   GET_FD(iterFd, cpu_iter_core_separated);
   GET_FD(devmapFd, devmap);
-  GET_FD(txCtrFd, tx_packet_ctr);
-  GET_FD(rxCtrFd, rx_packet_ctr);
-  GET_FD(totalSrvTimeFd, total_srv_time);
+  GET_FD(inflightFd, cpu_inflight);
+  GET_FD(workFd, cpu_outstanding_work);
+  GET_FD(tightDeadlineFd, edf_tight_deadline);
+
+  if (bpf_map_update_elem(tightDeadlineFd, &key0, &tightDeadlineUs, 0)) return -1;
+
+  // order in which the cpumap kthreads are created, used for display
+  std::vector<int> allCpus(cpusShort);
+  allCpus.insert(allCpus.end(), cpusLong.begin(), cpusLong.end());
 
   __u32 cpusShortSize = cpusShort.size();
   __u32 cpusLongSize = cpusLong.size();
@@ -221,13 +553,17 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
   cpusLongSize = 0;
   bpf_map_lookup_elem(countFd, &key0, &cpusShortSize);
   bpf_map_lookup_elem(countFd, &key1, &cpusLongSize);
+  if (seedRoundRobinCursor(iterFd, key0, cpusShortSize, ifname) ||
+      seedRoundRobinCursor(iterFd, key1, cpusLongSize, ifname)) {
+    return -1;
+  }
 
   int ret;
 
   int cpuProgFd = bpf_program__fd(skel.get()->progs.bpfnic_benchmark_cpu_func);
-  struct bpf_cpumap_val *val = (struct bpf_cpumap_val *)malloc(sizeof(struct bpf_cpumap_val));
-  val->qsize = (1 << 12);  // big queue
-  val->bpf_prog.fd = cpuProgFd;
+  // cpus moved between groups by the adaptive split keep their queue size
+  struct bpf_cpumap_val shortVal = cpumapEntry(cpuProgFd, false);
+  struct bpf_cpumap_val longVal = cpumapEntry(cpuProgFd, true);
 
   // add all short-request-reserved CPUs to needed maps
   for (__u32 i = 0; i < (__u32)cpusShortSize; i++) {
@@ -238,7 +574,7 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
       exit(1);
     }
 
-    if ((ret = bpf_map_update_elem(mapFd, &currCpu, val, 0))) {
+    if ((ret = bpf_map_update_elem(mapFd, &currCpu, &shortVal, 0))) {
       std::cout << "Failed to create cpumap entry " << i << ": " << strerror(errno) << std::endl;
       exit(1);
     }
@@ -253,7 +589,7 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
       exit(1);
     }
 
-    if ((ret = bpf_map_update_elem(mapFd, &currCpu, val, 0))) {
+    if ((ret = bpf_map_update_elem(mapFd, &currCpu, &longVal, 0))) {
       std::cout << "Failed to create cpumap entry " << i << ": " << strerror(errno) << std::endl;
       exit(1);
     }
@@ -276,34 +612,39 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
   struct bpf_devmap_val devmapEntry = {.ifindex = (__u32)ifindex};
   bpf_map_update_elem(devmapFd, &key0, &devmapEntry, 0);
 
-  auto link = bpf_program__attach_xdp(skel.get()->progs.bpf_redirect_roundrobin_core_separated, ifindex);
-
+  struct bpf_program *prog = bpf_object__find_program_by_name(skel.get()->obj, progName);
+  if (!prog) {
+    std::cerr << "Unable to find program " << progName << std::endl;
+    return -1;
+  }
+  auto link = bpf_program__attach_xdp(prog, ifindex);
   if (!link) exit(1);
 
   std::cout << "Loaded on " << ifname << "; " << ifindex << std::endl;
 
-  __u64 txValues[BUFFER_SIZE] = {0};
-  __u64 srvTimes[BUFFER_SIZE] = {0};
-  __u64 rxValue = 0;
-
-  // set counters to 0 initially
-  // bpf_map_update_elem(txCtrFd, &key0, txValues, 0);
-  // bpf_map_update_elem(rxCtrFd, &key0, &rxValue, 0);
+  StatsCollector stats;
+  if (initStatsCollector(skel, stats)) return -1;
 
   std::ofstream rxTxFile("server_results/rx_tx.csv");
   rxTxFile << "rx,tx" << std::endl;
 
+  std::ofstream qdPercentilesFile = openQdPercentilesFile();
+  std::ofstream queueDepthsFile = openQueueDepthsFile();
+
+  ControlLoop controlLoop(periodMs);
+  if (!controlLoop.isValid()) return -1;
+  int numWindows = controlLoop.windowsIn(duration);
+
   /* MAIN LOOP */
-  for (int time = 0; time < duration; time++) {
+  for (int time = 0; time < numWindows;) {
     /* book-keeping */
-    __u64 totalTxPackets = 0;
-    if (bpf_map_lookup_elem(txCtrFd, &key0, txValues)) exit(1);
-    if (bpf_map_lookup_elem(totalSrvTimeFd, &key0, srvTimes)) exit(1);
-    if (bpf_map_lookup_elem(rxCtrFd, &key0, &rxValue)) exit(1);
+    stats.collect();
+    auto& window = stats.getWindow();
 
     /* DISPLAY */
-    system("clear");
-    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << duration << "\n";
+    ControlLoop::redrawScreen();
+    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << numWindows << " ("
+              << controlLoop.getMissedWindows() << " missed, " << periodMs << " ms windows)\n";
 
     std::cout << "Short core group = [ ";
     for (int cpu : cpusShort) std::cout << cpu << ", ";
@@ -316,73 +657,224 @@ int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector
     // sanity check
     std::cout << "count short = " << cpusShortSize << ", count long = " << cpusLongSize << "\n";
 
-    std::cout << "\tAvg. queuing delays\n";
+    printAvgQueuingDelays(stats);
+    reportQdPercentiles(stats, time, qdPercentilesFile);
+    reportQueueDepths(inflightFd, workFd, stats, allCpus, time, queueDepthsFile);
 
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-      totalTxPackets += txValues[i];
+    // BEGIN: ADAPTIVE SPLIT LOGIC
+    if (adaptiveSplit) {
+      __u64 shortWork = 0, longWork = 0;
+      for (int cpu : cpusShort) shortWork += window.at(cpu).work;
+      for (int cpu : cpusLong) longWork += window.at(cpu).work;
 
-      if (srvTimes[i] > 0 && txValues[i] > 0) {
-        std::cout << "\t\tcpu_" << i << " = " << ((double)srvTimes[i] / txValues[i]) / 1000.0 << " μs\n";
-      }
-    }
+      std::cout << "\tWork: short = " << shortWork << " μs, long = " << longWork << " μs\n";
 
-    // clear arrays - state is kept per-window
-    std::fill(std::begin(srvTimes), std::end(srvTimes), 0);
-    std::fill(std::begin(txValues), std::end(txValues), 0);
+      __u32 target = targetLongGroupSize(shortWork, longWork, allCpus.size(), cpusLongSize);
+      // move one cpu per window at most, letting queues settle in between
+      if (target > cpusLongSize)
+        moveCpuBetweenGroups(cpusShort, key0, cpusLong, key1, availLongFd, countFd);
+      else if (target < cpusLongSize)
+        moveCpuBetweenGroups(cpusLong, key1, cpusShort, key0, availShortFd, countFd);
 
-    __u64 zero = 0;
-    bpf_map_update_elem(txCtrFd, &key0, txValues, 0);
-    bpf_map_update_elem(totalSrvTimeFd, &key0, srvTimes, 0);
-    bpf_map_update_elem(rxCtrFd, &key0, &zero, 0);
+      cpusShortSize = cpusShort.size();
+      cpusLongSize = cpusLong.size();
+    }
+    // END: ADAPTIVE SPLIT LOGIC
 
-    std::cout << "\n\treceived " << rxValue << " |  sent " << totalTxPackets << "\n";
-    rxTxFile << rxValue << "," << totalTxPackets << std::endl;
+    std::cout << "\n\treceived " << stats.getWindowRx() << " |  sent " << stats.getWindowTx() << " |  shed "
+              << stats.getWindowShed() << "\n";
+    rxTxFile << stats.getWindowRx() << "," << stats.getWindowTx() << std::endl;
 
     auto cpuUtilizations = procParser.getCpuUtilizationVec();
 
     std::cout << "\tCpu utizations: " << std::endl;
     for (unsigned int i = 0; i < cpuUtilizations.size(); i++) {
-      int cpu;
-      if (i < cpusShortSize)
-        cpu = cpusShort.at(i);
+      std::cout << "\t\t" << procParser.getKeyWord() << "_" << allCpus.at(i) << ": " << cpuUtilizations.at(i) * 100.0
+                << "% \n";
+    }
+    std::cout << std::endl;  // flush stdout
+    int elapsedWindows = controlLoop.waitForNextWindow();
+    if (elapsedWindows < 0) exit(1);
+    time += elapsedWindows;
+  }
+
+  return 0;
+}
+
+int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector<int>& cpusLong, std::string& ifname,
+                                        __u16 port, int duration, int periodMs, int traceSampleRate,
+                                        bool adaptiveSplit) {
+  return redirectProgCoreSeparatedImpl(cpusShort, cpusLong, ifname, port, duration, periodMs, traceSampleRate,
+                                       adaptiveSplit, "bpf_redirect_roundrobin_core_separated", 0);
+}
+
+int redirectProgDeadline(std::vector<int>& cpusLowLatency, std::vector<int>& cpusBestEffort, std::string& ifname,
+                         __u16 port, int duration, int periodMs, int traceSampleRate, int tightDeadlineUs) {
+  return redirectProgCoreSeparatedImpl(cpusLowLatency, cpusBestEffort, ifname, port, duration, periodMs,
+                                       traceSampleRate, false, "bpf_redirect_edf", tightDeadlineUs);
+}
+
+int redirectProgTiered(std::vector<std::vector<int>>& tierCpus, std::vector<int>& tierBounds, std::string& ifname,
+                       __u16 port, int duration, int periodMs, int traceSampleRate) {
+  int err;
+  int portFd, mapFd, devmapFd, boundsFd, tierCountFd, tierCpusFd, tierCpuCountFd, tierIterFd, inflightFd, workFd;
+  __u32 key0 = 0;
+  auto skel = Skeleton<bpfnic>();
+  auto procParser = ProcParser(CPUMAP_QUERY);
+
+  if (tierCpus.empty() || tierCpus.size() > MAX_TIERS || tierBounds.size() + 1 != tierCpus.size()) {
+    std::cerr << "Invalid tier configuration" << std::endl;
+    return -1;
+  }
+
+  if (openAndLoadSkeleton(skel)) return -1;
+
+  SchedTracer tracer;
+  if (startSchedTrace(skel, traceSampleRate, tracer)) return -1;
+
+  GET_FD(portFd, port_num);
+  GET_FD(mapFd, cpu_map);
+  GET_FD(devmapFd, devmap);
+  GET_FD(boundsFd, tier_bounds);
+  GET_FD(tierCountFd, tier_count);
+  GET_FD(tierCpusFd, tier_cpus);
+  GET_FD(tierCpuCountFd, tier_cpu_count);
+  GET_FD(tierIterFd, tier_iter);
+  GET_FD(inflightFd, cpu_inflight);
+  GET_FD(workFd, cpu_outstanding_work);
+
+  int cpuProgFd = bpf_program__fd(skel.get()->progs.bpfnic_benchmark_cpu_func);
+
+  // order in which the cpumap kthreads are created, used for display
+  std::vector<int> allCpus;
+
+  for (__u32 tier = 0; tier < (__u32)tierCpus.size(); tier++) {
+    __u32 tierSize = tierCpus[tier].size();
+    if (tierSize == 0 || tierSize > MAX_SCHED_CPUS) {
+      std::cerr << "Invalid number of cpus for tier " << tier << ": " << tierSize << std::endl;
+      return -1;
+    }
+
+    for (__u32 i = 0; i < tierSize; i++) {
+      __u32 currCpu = tierCpus[tier].at(i);
+      __u32 key = tier * MAX_SCHED_CPUS + i;
+      std::cout << "adding cpu_" << currCpu << " to tier " << tier << std::endl;
+      if ((err = bpf_map_update_elem(tierCpusFd, &key, &currCpu, 0))) {
+        std::cout << "Failed to create tier entry " << key << ": " << strerror(errno) << std::endl;
+        exit(1);
+      }
+
+      // the last tier takes the longest requests
+      struct bpf_cpumap_val cpumapVal = cpumapEntry(cpuProgFd, tier + 1 == tierCpus.size());
+      if ((err = bpf_map_update_elem(mapFd, &currCpu, &cpumapVal, 0))) {
+        std::cout << "Failed to create cpumap entry " << currCpu << ": " << strerror(errno) << std::endl;
+        exit(1);
+      }
+      allCpus.push_back(currCpu);
+    }
+
+    if (bpf_map_update_elem(tierCpuCountFd, &tier, &tierSize, 0)) exit(1);
+    if (seedRoundRobinCursor(tierIterFd, tier, tierSize, ifname)) return -1;
+  }
+
+  for (__u32 i = 0; i < (__u32)tierBounds.size(); i++) {
+    __u32 bound = tierBounds[i];
+    if (bpf_map_update_elem(boundsFd, &i, &bound, 0)) exit(1);
+  }
+
+  __u32 numTiers = tierCpus.size();
+  if (bpf_map_update_elem(tierCountFd, &key0, &numTiers, 0)) exit(1);
+  bpf_map_update_elem(portFd, &key0, &port, 0);
+
+  int ifindex = if_nametoindex(ifname.c_str());
+  if (!ifindex) {
+    std::cout << "Failed to find ifindex for " << ifname << ": " << strerror(errno) << std::endl;
+    exit(1);
+  }
+
+  struct bpf_devmap_val devmapEntry = {.ifindex = (__u32)ifindex};
+  bpf_map_update_elem(devmapFd, &key0, &devmapEntry, 0);
+
+  auto link = bpf_program__attach_xdp(skel.get()->progs.bpf_redirect_tiered, ifindex);
+  if (!link) exit(1);
+
+  std::cout << "Loaded on " << ifname << "; " << ifindex << std::endl;
+
+  StatsCollector stats;
+  if (initStatsCollector(skel, stats)) return -1;
+
+  std::ofstream qdPercentilesFile = openQdPercentilesFile();
+  std::ofstream queueDepthsFile = openQueueDepthsFile();
+
+  ControlLoop controlLoop(periodMs);
+  if (!controlLoop.isValid()) return -1;
+  int numWindows = controlLoop.windowsIn(duration);
+
+  /* MAIN LOOP */
+  for (int time = 0; time < numWindows;) {
+    /* book-keeping */
+    stats.collect();
+
+    /* DISPLAY */
+    ControlLoop::redrawScreen();
+    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << numWindows << " ("
+              << controlLoop.getMissedWindows() << " missed, " << periodMs << " ms windows)\n";
+
+    for (unsigned tier = 0; tier < tierCpus.size(); tier++) {
+      std::cout << "Tier " << tier << " (srv_time ";
+      if (tier < tierBounds.size())
+        std::cout << "< " << tierBounds[tier];
       else
-        cpu = cpusLong.at(i - cpusShortSize);
+        std::cout << ">= " << (tierBounds.empty() ? 0 : tierBounds.back());
+      std::cout << ") core group = [ ";
+      for (int cpu : tierCpus[tier]) std::cout << cpu << ", ";
+      std::cout << "]\n";
+    }
+
+    printAvgQueuingDelays(stats);
+    reportQdPercentiles(stats, time, qdPercentilesFile);
+    reportQueueDepths(inflightFd, workFd, stats, allCpus, time, queueDepthsFile);
 
-      std::cout << "\t\t" << procParser.getKeyWord() << "_" << cpu << ": " << cpuUtilizations.at(i) * 100.0 << "% \n";
+    std::cout << "\n\treceived " << stats.getWindowRx() << " |  sent " << stats.getWindowTx() << " |  shed "
+              << stats.getWindowShed() << "\n";
+
+    auto cpuUtilizations = procParser.getCpuUtilizationVec();
+
+    std::cout << "\tCpu utizations: " << std::endl;
+    for (unsigned int i = 0; i < cpuUtilizations.size(); i++) {
+      std::cout << "\t\t" << procParser.getKeyWord() << "_" << allCpus.at(i) << ": " << cpuUtilizations.at(i) * 100.0
+                << "% \n";
     }
     std::cout << std::endl;  // flush stdout
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    int elapsedWindows = controlLoop.waitForNextWindow();
+    if (elapsedWindows < 0) exit(1);
+    time += elapsedWindows;
   }
 
   return 0;
 }
 
-#define MAX_CPUS 8
 #define MIN_CPUS 2
-#define QD_THRESHOLD 200.0
 
-/// adds one CPU to the core group
-void addOneCPU(int countFd) {
+/// adds up to `n` CPUs to the core group, without exceeding the `maxCpus` cpus available to it
+void addCPUs(int countFd, int n, int maxCpus) {
   int cpuCount;
   int key0 = 0;
   if (bpf_map_lookup_elem(countFd, &key0, &cpuCount)) exit(1);
 
-  // TODO: Code to add a CPU
-  // cpuCount after lookup will contain the current value
-  
-  if (cpuCount < MAX_CPUS){    
-    cpuCount += 1;
-    bpf_map_update_elem(countFd, &key0, &cpuCount, 0);
-  }
+  int newCount = std::min(cpuCount + n, maxCpus);
+  if (newCount > cpuCount) bpf_map_update_elem(countFd, &key0, &newCount, 0);
 }
 
+/// adds one CPU to the core group, without exceeding the `maxCpus` cpus available to it
+void addOneCPU(int countFd, int maxCpus) { addCPUs(countFd, 1, maxCpus); }
+
 /// removes one CPU from the core group
 void removeOneCPU(int countFd) {
   int cpuCount;
   int key0 = 0;
   if (bpf_map_lookup_elem(countFd, &key0, &cpuCount)) exit(1);
 
-  // TODO: Code to remove a CPU
   // cpuCount after lookup will contain the current value
   if (cpuCount > MIN_CPUS){    
     cpuCount -= 1;
@@ -390,59 +882,57 @@ void removeOneCPU(int countFd) {
   }
 }
 
-/// @return the average queuing delay across all cores that have sent packets
-double computeAverageQueuingDelay(int totalSrvTimeFd, int txCtrFd) {
-  int key0 = 0;
-  __u64 txValues[BUFFER_SIZE] = {0};  // holds the number of received packets per-cpu
-  __u64 srvTimes[BUFFER_SIZE] = {0};  // holds the total queuing delay time per-cpu
+// p99 below this fraction of the target lets dca remove a cpu
+#define P99_SCALE_DOWN_RATIO 0.5
 
-  if (bpf_map_lookup_elem(txCtrFd, &key0, txValues)) exit(1);
-  if (bpf_map_lookup_elem(totalSrvTimeFd, &key0, srvTimes)) exit(1);
+/**
+ * Proportional step of the p99 controller: the core group grows by its size
+ * times the relative violation of the target, such that a large violation
+ * adds several cpus in a single window.
+ * @return the number of cpus to add, at least 1 when `p99Us` exceeds the target
+ */
+static int p99ScaleUpStep(double p99Us, double targetUs, __u32 groupSize, double gain) {
+  if (p99Us <= targetUs) return 0;
+  double violation = (p99Us - targetUs) / targetUs;
+  return std::max(1, (int)std::ceil(gain * violation * groupSize));
+}
 
-  __u64 totalQueuingDelay = 0;
-  __u64 totalTxPackets = 0;
-  for (int i = 0; i < BUFFER_SIZE; i++) {
-    totalQueuingDelay += srvTimes[i];
-    totalTxPackets += txValues[i];
-  }
+/**
+ * @return the average fraction of the last `windowNanos` nanoseconds that the
+ * first `groupSize` cpus in `cpus` spent processing requests, where `window`
+ * holds the per-cpu counters accumulated over the window
+ */
+static double computeGroupBusyUtilization(const std::vector<struct cpu_counters>& window, const std::vector<int>& cpus,
+                                          __u32 groupSize, double windowNanos) {
+  if (groupSize == 0 || windowNanos <= 0.0) return 0.0;
 
-  return totalTxPackets > 0 ? (double)totalQueuingDelay / (double)totalTxPackets : 0.0;
+  double totalBusyTime = 0.0;
+  for (__u32 i = 0; i < groupSize && i < cpus.size(); i++) totalBusyTime += window.at(cpus.at(i)).busy_time;
+
+  return totalBusyTime / (windowNanos * groupSize);
 }
 
-int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string& ifname, __u16 port, int duration) {
+/**
+ * Dynamic core allocation over the core group `availCpus`, scaling on the
+ * smoothed average queuing delay, or on the in-kernel measured cpu utilization
+ * of the core group if `scaleOnUtilization` is set. Both gate scale-downs on
+ * that in-kernel utilization.
+ */
+static int redirectProgDynamicCoreAllocationImpl(std::vector<int>& availCpus, std::string& ifname, __u16 port,
+                                                 int duration, int periodMs, int traceSampleRate,
+                                                 const DcaOptions& dcaOpts, bool scaleOnUtilization) {
   int err;
-  int portFd, availFd, mapFd, iterFd, countFd, devmapFd, txCtrFd, rxCtrFd, totalSrvTimeFd;
+  int portFd, availFd, mapFd, iterFd, countFd, devmapFd, inflightFd, workFd;
   int cpumapProgFd;
-  int numCpus;
   __u32 key0 = 0;
   std::vector<int> coreGroup;
   auto skel = Skeleton<bpfnic>();
   auto procParser = ProcParser(CPUMAP_QUERY);
 
-  struct bpf_object_open_opts opts;
-  memset(&opts, 0, sizeof(struct bpf_object_open_opts));
-  opts.sz = sizeof(struct bpf_object_open_opts);
-  err = skel.open(&opts);
-  if (err) {
-    std::cout << "Unable to open skel: " << strerror(err) << std::endl;
-    return -1;
-  } else {
-    std::cout << "successfully opened skel" << std::endl;
-  }
+  if (openAndLoadSkeleton(skel)) return -1;
 
-  numCpus = libbpf_num_possible_cpus();
-  SET_MAX_ENTRIES(cpu_map, numCpus);
-  SET_MAX_ENTRIES(cpus_available, numCpus);
-  SET_MAX_ENTRIES(cpus_available_long_reqs, numCpus);
-  SET_MAX_ENTRIES(cpus_available_short_reqs, numCpus);
-
-  err = skel.load();
-  if (err) {
-    std::cout << "err load: " << err << std::endl;
-    return -1;
-  } else {
-    std::cout << "successfully loaded skel" << std::endl;
-  }
+  SchedTracer tracer;
+  if (startSchedTrace(skel, traceSampleRate, tracer)) return -1;
 
   GET_FD(portFd, port_num);
   GET_FD(mapFd, cpu_map);
@@ -450,26 +940,25 @@ int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string&
   GET_FD(availFd, cpus_available);
   GET_FD(iterFd, cpu_iter);
   GET_FD(devmapFd, devmap);
-  GET_FD(txCtrFd, tx_packet_ctr);
-  GET_FD(rxCtrFd, rx_packet_ctr);
-  GET_FD(totalSrvTimeFd, total_srv_time);
+  GET_FD(inflightFd, cpu_inflight);
+  GET_FD(workFd, cpu_outstanding_work);
 
   cpumapProgFd = bpf_program__fd(skel.get()->progs.bpfnic_benchmark_cpu_func);
 
   // initialize cpumap programs
-  struct bpf_cpumap_val *val = (struct bpf_cpumap_val *)malloc(sizeof(struct bpf_cpumap_val));
-  val->qsize = (1 << 12);
-  val->bpf_prog.fd = cpumapProgFd;
+  struct bpf_cpumap_val val = cpumapEntry(cpumapProgFd, false);
 
   // insert into the cpumap
   for (__u32 i = 0; i < (__u32)availCpus.size(); i++) {
     __u32 currCpu = availCpus.at(i);
 
     if ((err = bpf_map_update_elem(availFd, &i, &currCpu, 0))) exit(1);
-    if ((err = bpf_map_update_elem(mapFd, &currCpu, val, 0))) exit(1);
+    if ((err = bpf_map_update_elem(mapFd, &currCpu, &val, 0))) exit(1);
   }
 
   bpf_map_update_elem(portFd, &key0, &port, 0);
+  // the group grows up to all the available cpus, smaller groups wrap the offsets around
+  if (seedRoundRobinCursor(iterFd, key0, availCpus.size(), ifname)) return -1;
 
   int ifindex = if_nametoindex(ifname.c_str());
   if (!ifindex) {
@@ -480,7 +969,11 @@ int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string&
   struct bpf_devmap_val devmapEntry = {.ifindex = (__u32)ifindex};
   bpf_map_update_elem(devmapFd, &key0, &devmapEntry, 0);
 
-  auto link = bpf_program__attach_xdp(skel.get()->progs.bpf_redirect_roundrobin, ifindex);
+  // cpus are added and removed at the end of `cpus_available`, which is what
+  // consistent hashing needs to only move the flows of that cpu. The group grows
+  // under load rather than spilling flows, hence no spill threshold
+  auto prog = dcaOpts.flowHash ? skel.get()->progs.bpf_redirect_hash : skel.get()->progs.bpf_redirect_roundrobin;
+  auto link = bpf_program__attach_xdp(prog, ifindex);
   if (!link) exit(1);
 
   // we start with one cpu, and add more when threshold latency is surpassed
@@ -489,52 +982,89 @@ int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string&
 
   std::cout << "Attached xdp program to " << ifname << ", ifindex=" << ifindex << std::endl;
 
-  __u64 txValues[BUFFER_SIZE] = {0};  // holds the number of received packets per-cpu
-  __u64 srvTimes[BUFFER_SIZE] = {0};  // holds the total queuing delay time per-cpu
-  __u64 rxValue = 0;                  // holds the total number of received packets across all CPUs
+  StatsCollector stats;
+  if (initStatsCollector(skel, stats)) return -1;
+
+  double smoothedQd = 0.0;  // EWMA of the average queuing delay in microseconds
+  int cooldown = 0;         // windows left before the next scaling decision
+  auto windowStart = std::chrono::steady_clock::now();
+
+  std::ofstream qdPercentilesFile = openQdPercentilesFile();
+  std::ofstream queueDepthsFile = openQueueDepthsFile();
+
+  ControlLoop controlLoop(periodMs);
+  if (!controlLoop.isValid()) return -1;
+  int numWindows = controlLoop.windowsIn(duration);
 
   /* MAIN LOOP */
-  for (int time = 0; time < duration; time++) {
+  for (int time = 0; time < numWindows;) {
     /* book-keeping */
-    __u64 totalTxPackets = 0;
-    if (bpf_map_lookup_elem(txCtrFd, &key0, txValues)) exit(1);
-    if (bpf_map_lookup_elem(totalSrvTimeFd, &key0, srvTimes)) exit(1);
-    if (bpf_map_lookup_elem(rxCtrFd, &key0, &rxValue)) exit(1);
+    stats.collect();
+    if (bpf_map_lookup_elem(countFd, &key0, &cpusCount)) exit(1);
+
+    auto windowEnd = std::chrono::steady_clock::now();
+    double windowNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(windowEnd - windowStart).count();
+    windowStart = windowEnd;
 
     /* DISPLAY */
-    system("clear");
-    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << duration << "\n";
+    ControlLoop::redrawScreen();
+    std::cout << "\nCycle Summary. Iter N° " << time << " out of " << numWindows << " ("
+              << controlLoop.getMissedWindows() << " missed, " << periodMs << " ms windows)\n";
     std::cout << "Core group size = " << cpusCount << "\n";
-    std::cout << "\tAvg. queuing delays\n";
 
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-      totalTxPackets += txValues[i];
+    printAvgQueuingDelays(stats);
+    QdPercentiles qdPercentiles = reportQdPercentiles(stats, time, qdPercentilesFile);
+    reportQueueDepths(inflightFd, workFd, stats, availCpus, time, queueDepthsFile);
 
-      if (srvTimes[i] > 0 && txValues[i] > 0) {
-        std::cout << "\t\tcpu_" << i << " = " << ((double)srvTimes[i] / txValues[i]) / 1000.0 << " μs\n";
-      }
-    }
+    // utilizations are computed once per window, as computing them resets
+    // the memoized state of the parser. They are only displayed: scaling
+    // decisions use the busy time measured in-kernel over the same window
+    std::vector<double> cpuUtilizations = procParser.getCpuUtilizationVec();
+    double avgUtilization = ProcParser::averageCpuUtilization(cpuUtilizations);
 
     // BEGIN: CORE ADDITION LOGIC
-    // TODO: Add logic to observe queueing delay and add cores
-    double average_qd = ((double)computeAverageQueuingDelay(totalSrvTimeFd, txCtrFd) )/ 1000.0; // in microsecond
-    if (average_qd > QD_THRESHOLD)
-      addOneCPU(countFd);
-
+    double average_qd = stats.getAverageQueuingDelay() / 1000.0;  // in microsecond
+    smoothedQd = time == 0 ? average_qd : dcaOpts.ewmaAlpha * average_qd + (1.0 - dcaOpts.ewmaAlpha) * smoothedQd;
+
+    double busyUtilization = computeGroupBusyUtilization(stats.getWindow(), availCpus, cpusCount, windowNanos);
+
+    std::cout << "\tSmoothed avg. queuing delay = " << smoothedQd << " μs, avg. utilization = "
+              << avgUtilization * 100.0 << "%, core group busy = " << busyUtilization * 100.0 << "%\n";
+
+    // thresholds are apart from each other and decisions are followed by a
+    // cooldown, such that the core group does not flap between sizes
+    if (cooldown > 0) {
+      cooldown--;
+    } else if (scaleOnUtilization) {
+      if (busyUtilization > dcaOpts.scaleUpUtilization) {
+        addOneCPU(countFd, availCpus.size());
+        cooldown = dcaOpts.cooldownWindows;
+      } else if (busyUtilization < dcaOpts.scaleDownUtilization) {
+        removeOneCPU(countFd);
+        cooldown = dcaOpts.cooldownWindows;
+      }
+    } else if (dcaOpts.p99TargetUs > 0) {
+      if (qdPercentiles.p99 > dcaOpts.p99TargetUs) {
+        addCPUs(countFd, p99ScaleUpStep(qdPercentiles.p99, dcaOpts.p99TargetUs, cpusCount, dcaOpts.p99Gain),
+                availCpus.size());
+        cooldown = dcaOpts.cooldownWindows;
+      } else if (qdPercentiles.p99 < dcaOpts.p99TargetUs * P99_SCALE_DOWN_RATIO &&
+                 busyUtilization < dcaOpts.scaleDownUtilization) {
+        removeOneCPU(countFd);
+        cooldown = dcaOpts.cooldownWindows;
+      }
+    } else if (smoothedQd > dcaOpts.scaleUpDelayUs) {
+      addOneCPU(countFd, availCpus.size());
+      cooldown = dcaOpts.cooldownWindows;
+    } else if (smoothedQd < dcaOpts.scaleDownDelayUs && busyUtilization < dcaOpts.scaleDownUtilization) {
+      removeOneCPU(countFd);
+      cooldown = dcaOpts.cooldownWindows;
+    }
     // END: CORE ADDITION LOGIC
 
-    // clear arrays - state is kept per-window
-    std::fill(std::begin(srvTimes), std::end(srvTimes), 0);
-    std::fill(std::begin(txValues), std::end(txValues), 0);
-
-    __u64 zero = 0;
-    bpf_map_update_elem(txCtrFd, &key0, txValues, 0);
-    bpf_map_update_elem(totalSrvTimeFd, &key0, srvTimes, 0);
-    bpf_map_update_elem(rxCtrFd, &key0, &zero, 0);
+    std::cout << "\n\treceived " << stats.getWindowRx() << " |  sent " << stats.getWindowTx() << " |  shed "
+              << stats.getWindowShed() << " |  stolen " << stats.getWindowStolen() << "\n";
 
-    std::cout << "\n\treceived " << rxValue << " |  sent " << totalTxPackets << "\n";
-
-    std::vector<double> cpuUtilizations = procParser.getCpuUtilizationVec();
     // the display logic assumes that `cpumap_i+1` is always parsed after
     // `cpumap_i`
     std::cout << "\tCpu utizations: " << std::endl;
@@ -543,8 +1073,23 @@ int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string&
                 << "% \n";
     }
     std::cout << std::endl;  // flush stdout
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    int elapsedWindows = controlLoop.waitForNextWindow();
+    if (elapsedWindows < 0) exit(1);
+    time += elapsedWindows;
   }
 
   return 0;
 }
+
+int redirectProgDynamicCoreAllocation(std::vector<int>& availCpus, std::string& ifname, __u16 port, int duration,
+                                      int periodMs, int traceSampleRate, const DcaOptions& dcaOpts) {
+  return redirectProgDynamicCoreAllocationImpl(availCpus, ifname, port, duration, periodMs, traceSampleRate, dcaOpts,
+                                               false);
+}
+
+int redirectProgDynamicCoreAllocationUtilization(std::vector<int>& availCpus, std::string& ifname, __u16 port,
+                                                 int duration, int periodMs, int traceSampleRate,
+                                                 const DcaOptions& dcaOpts) {
+  return redirectProgDynamicCoreAllocationImpl(availCpus, ifname, port, duration, periodMs, traceSampleRate, dcaOpts,
+                                               true);
+}
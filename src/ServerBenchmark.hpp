@@ -3,41 +3,129 @@
 #include <net/if.h>
 #include <unistd.h>
 
+#include <ProgramOptions.hpp>
 #include <string>
 #include <vector>
 
 #ifndef SERVER_BENCHMARK
 #define SERVER_BENCHMARK
 
+/*
+ * All policies below run their statistics and control logic once every
+ * `periodMs` milliseconds, and sample one in `traceSampleRate` scheduling
+ * decisions into SCHED_TRACE_FILEPATH unless it is 0.
+ */
+
+/**
+ * Lets the cpumap program of a cpu with at least `queueThreshold` outstanding
+ * requests hand requests over to an idle cpu of the core group, at most `maxHops`
+ * times per request. Applies to the policies scheduling over a single core group
+ * (rr, jsq, p2c, hash, dca, dcau) started afterwards. 0 disables stealing (default).
+ */
+void configureWorkStealing(int queueThreshold, int maxHops);
+
+/**
+ * Sheds requests whose predicted queuing delay, the outstanding work of the cpu
+ * they are scheduled on, exceeds `deadlineUs` microseconds. They are dropped, or
+ * sent back flagged as overloaded with `reply`. Applies to the policies started
+ * afterwards. 0 admits all requests (default).
+ */
+void configureAdmissionControl(int deadlineUs, bool reply);
+
+/**
+ * Sets the size of the cpumap queue of every cpu to `qsize` packets, except for
+ * the cpus taking long requests (long group of rrcs/acs, last tier) which get
+ * `qsizeLong`. Applies to the policies started afterwards.
+ */
+void configureCpumapQueues(int qsize, int qsizeLong);
+
 /**
  * BPF scheduling policy that redirects packtets to a cpu in `cpus` in round-robin
  * fashion. Loads program onto `ifname` and expects traffic at `port`
  * Lasts for `duration` seconds because terminating
  */
-int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration);
+int redirectProgRoundRobin(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                           int traceSampleRate);
+
+/**
+ * BPF scheduling policy that redirects packets to the cpu in `cpus` with the
+ * fewest outstanding requests (join-shortest-queue). Loads program onto `ifname`
+ * and expects traffic at `port`. Lasts for `duration` seconds before terminating
+ */
+int redirectProgJoinShortestQueue(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                                  int traceSampleRate);
+
+/**
+ * BPF scheduling policy that samples two cpus in `cpus` at random and redirects
+ * packets to the one with the least outstanding work (power-of-two-choices).
+ * Loads program onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds before terminating
+ */
+int redirectProgPowerOfTwo(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                           int traceSampleRate);
+
+/**
+ * BPF scheduling policy that steers all packets of a flow to the same cpu in `cpus`
+ * by consistent hashing of their 5-tuple, such that resizing the core group only
+ * moves the flows of the added or removed cpu. Packets spill over to the cpu with
+ * the fewest outstanding requests when their hashed cpu has at least `spillThreshold`
+ * of them, unless it is 0. Loads program onto `ifname` and expects traffic at `port`.
+ * Lasts for `duration` seconds before terminating
+ */
+int redirectProgFlowHash(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration, int periodMs,
+                         int traceSampleRate, int spillThreshold);
 
 /**
  * BPF scheduling policy that redirects packtets to a cpu in `cpus` in round-robin
  * fashion with core-separation between long and short requests. Loads program
  * onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds because terminating
+ *
+ * With `adaptiveSplit`, cpus are moved between both groups every control window such that
+ * the split follows the ratio of work performed by short and long requests.
  */
 int redirectProgRoundRobinCoreSeparated(std::vector<int>& cpusShort, std::vector<int>& cpusLong, std::string& ifname,
-                                        __u16 port, int duration);
+                                        __u16 port, int duration, int periodMs, int traceSampleRate,
+                                        bool adaptiveSplit = false);
+
+/**
+ * BPF scheduling policy that sends requests whose deadline is at most `tightDeadlineUs`
+ * to the cpu of `cpusLowLatency` with the least outstanding work, or to the least
+ * loaded cpu of `cpusBestEffort` if it would otherwise miss its deadline. Other requests
+ * are redirected to `cpusBestEffort` in round-robin fashion.
+ * Loads program onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds before terminating
+ */
+int redirectProgDeadline(std::vector<int>& cpusLowLatency, std::vector<int>& cpusBestEffort, std::string& ifname,
+                         __u16 port, int duration, int periodMs, int traceSampleRate, int tightDeadlineUs);
+
+/**
+ * BPF scheduling policy that classifies requests into service-time tiers, where
+ * tier `i` takes requests whose service time is below `tierBounds[i]` and the
+ * last tier takes the remaining ones. Requests are redirected in round-robin
+ * fashion to the cpus of their tier, `tierCpus[i]`.
+ * Loads program onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds before terminating
+ */
+int redirectProgTiered(std::vector<std::vector<int>>& tierCpus, std::vector<int>& tierBounds, std::string& ifname,
+                       __u16 port, int duration, int periodMs, int traceSampleRate);
 
 /**
  * BPF scheduling policy that redirects packtets to a cpu in `cpus` in round-robin
  * fashion, starting at one CPU and allocating more to the core group after surpassing
- * 20us avg queuing delay.
+ * the scale-up threshold of smoothed avg queuing delay, or in proportion to the
+ * violation of the p99 target if one is set. Cpus are given back when both the
+ * queuing delay and the cpu utilization fall below their scale-down thresholds.
+ * Steers flows by consistent hashing instead of round-robin with `dcaOpts.flowHash`.
  * Loads program onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds before terminating
  */
-int redirectProgDynamicCoreAllocation(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration);
+int redirectProgDynamicCoreAllocation(std::vector<int>& cpus, std::string& ifname, __u16 port, int duration,
+                                      int periodMs, int traceSampleRate, const DcaOptions& dcaOpts);
 
 /**
  * BPF scheduling policy that redirects packtets to a cpu in `cpus` in round-robin
  * fashion, starting at one CPU and allocating more to the core group after surpassing
- * 50% avg cpu utilization
+ * 50% avg cpu utilization (by default). Utilization is the share of time the cpus of
+ * the core group spend processing requests, as measured in-kernel by the cpumap program.
  * Loads program onto `ifname` and expects traffic at `port`. Lasts for `duration` seconds before terminating
  */
 int redirectProgDynamicCoreAllocationUtilization(std::vector<int>& availCpus, std::string& ifname, __u16 port,
-                                                 int duration);
+                                                 int duration, int periodMs, int traceSampleRate,
+                                                 const DcaOptions& dcaOpts);
 #endif
@@ -0,0 +1,164 @@
+#ifndef STATS_COLLECTOR
+#define STATS_COLLECTOR
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../common/histogram.h"
+#include "../common/stats.h"
+
+/**
+ * @brief read-only mapping of a `BPF_F_MMAPABLE` array map of `T`
+ */
+template <typename T>
+class MmapedArray {
+ private:
+  void *base = MAP_FAILED;
+  size_t length = 0;
+  size_t numEntries = 0;
+
+ public:
+  MmapedArray() = default;
+  MmapedArray(const MmapedArray&) = delete;
+  MmapedArray& operator=(const MmapedArray&) = delete;
+
+  ~MmapedArray() {
+    if (base != MAP_FAILED) munmap(base, length);
+  }
+
+  /// @return 0 on success, -1 on failure
+  int map(int fd, size_t entries) {
+    static_assert(sizeof(T) % sizeof(unsigned long long) == 0, "array values must be made of 8-byte words");
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+
+    numEntries = entries;
+    length = (entries * sizeof(T) + pageSize - 1) / pageSize * pageSize;
+    base = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+      std::cerr << "Unable to mmap array map: " << strerror(errno) << std::endl;
+      return -1;
+    }
+    return 0;
+  }
+
+  size_t size() const { return numEntries; }
+
+  /// copies entry `i` into `dst` with word-sized loads, as the kernel keeps on writing to it
+  void load(size_t i, T& dst) const {
+    auto *src = reinterpret_cast<const unsigned long long *>(static_cast<const T *>(base) + i);
+    auto *out = reinterpret_cast<unsigned long long *>(&dst);
+    for (size_t w = 0; w < sizeof(T) / sizeof(unsigned long long); w++)
+      out[w] = __atomic_load_n(&src[w], __ATOMIC_RELAXED);
+  }
+};
+
+/**
+ * @brief turns the monotonic counters that the BPF programs expose through
+ * mmap-able array maps into per-window deltas. Counters are never reset, such
+ * that no increment is lost to a read-then-reset race, and collecting a window
+ * takes no syscall.
+ */
+class StatsCollector {
+ private:
+  MmapedArray<struct cpu_counters> cpuStats;
+  MmapedArray<struct latency_hist> qdHists;
+  MmapedArray<struct rx_counter> rxCtrs;
+
+  std::vector<struct cpu_counters> prevCounters, windowCounters;
+  std::vector<struct latency_hist> prevHists, windowHists;
+  std::vector<struct rx_counter> prevRx;
+  unsigned long long windowRx = 0, windowShed = 0;
+
+ public:
+  /**
+   * Maps the `numCpus` slots of `cpuStatsFd`, `qdHistFd` and `rxCtrFd`, and
+   * takes the first snapshot
+   * @return 0 on success, -1 on failure
+   */
+  int init(int cpuStatsFd, int qdHistFd, int rxCtrFd, size_t numCpus) {
+    if (cpuStats.map(cpuStatsFd, numCpus) || qdHists.map(qdHistFd, numCpus) || rxCtrs.map(rxCtrFd, numCpus)) return -1;
+
+    prevCounters.resize(numCpus);
+    windowCounters.resize(numCpus);
+    prevHists.resize(numCpus);
+    windowHists.resize(numCpus);
+    prevRx.resize(numCpus);
+    collect();
+    return 0;
+  }
+
+  /// snapshots all counters and computes their deltas since the last call
+  void collect() {
+    for (size_t cpu = 0; cpu < cpuStats.size(); cpu++) {
+      struct cpu_counters curr;
+      cpuStats.load(cpu, curr);
+      windowCounters[cpu].tx_packets = curr.tx_packets - prevCounters[cpu].tx_packets;
+      windowCounters[cpu].srv_time = curr.srv_time - prevCounters[cpu].srv_time;
+      windowCounters[cpu].work = curr.work - prevCounters[cpu].work;
+      windowCounters[cpu].busy_time = curr.busy_time - prevCounters[cpu].busy_time;
+      windowCounters[cpu].stolen = curr.stolen - prevCounters[cpu].stolen;
+      windowCounters[cpu].enqueue_drops = curr.enqueue_drops - prevCounters[cpu].enqueue_drops;
+      prevCounters[cpu] = curr;
+    }
+
+    for (size_t cpu = 0; cpu < qdHists.size(); cpu++) {
+      struct latency_hist curr;
+      qdHists.load(cpu, curr);
+      for (size_t i = 0; i < HIST_NUM_BUCKETS; i++)
+        windowHists[cpu].buckets[i] = curr.buckets[i] - prevHists[cpu].buckets[i];
+      prevHists[cpu] = curr;
+    }
+
+    windowRx = 0;
+    windowShed = 0;
+    for (size_t cpu = 0; cpu < rxCtrs.size(); cpu++) {
+      struct rx_counter curr;
+      rxCtrs.load(cpu, curr);
+      windowRx += curr.packets - prevRx[cpu].packets;
+      windowShed += curr.shed - prevRx[cpu].shed;
+      prevRx[cpu] = curr;
+    }
+  }
+
+  /// @return counters of the last window, indexed by cpu
+  const std::vector<struct cpu_counters>& getWindow() const { return windowCounters; }
+
+  /// @return queuing delay histograms of the last window, indexed by cpu
+  const std::vector<struct latency_hist>& getWindowHists() const { return windowHists; }
+
+  /// @return number of packets received over the last window, across all cpus
+  unsigned long long getWindowRx() const { return windowRx; }
+
+  /// @return number of requests refused by admission control over the last window
+  unsigned long long getWindowShed() const { return windowShed; }
+
+  /// @return number of requests processed over the last window
+  unsigned long long getWindowTx() const {
+    unsigned long long total = 0;
+    for (auto& counters : windowCounters) total += counters.tx_packets;
+    return total;
+  }
+
+  /// @return number of requests handed over to an idle cpu over the last window
+  unsigned long long getWindowStolen() const {
+    unsigned long long total = 0;
+    for (auto& counters : windowCounters) total += counters.stolen;
+    return total;
+  }
+
+  /// @return the average queuing delay in ns over the last window, across all cpus
+  double getAverageQueuingDelay() const {
+    unsigned long long totalSrvTime = 0;
+    for (auto& counters : windowCounters) totalSrvTime += counters.srv_time;
+
+    unsigned long long totalTx = getWindowTx();
+    return totalTx > 0 ? (double)totalSrvTime / (double)totalTx : 0.0;
+  }
+};
+
+#endif
@@ -9,6 +9,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <memory>
@@ -20,12 +22,33 @@ UDPSocket::UDPSocket(int sockfd, struct sockaddr_in destAddr, struct sockaddr_in
     : destAddr(destAddr),
       srcAddr(srcAddr),
       sockfd(sockfd),
-      recvBuff(new char[RECV_BUFFER_LEN]),
-      recvBufferSize(RECV_BUFFER_LEN) {}
+      recvBuff(new char[RECV_BUFFER_LEN * MAX_IO_BATCH]),
+      recvBufferSize(RECV_BUFFER_LEN),
+      sendMsgs(MAX_IO_BATCH),
+      sendIovecs(MAX_IO_BATCH),
+      recvMsgs(MAX_IO_BATCH),
+      recvIovecs(MAX_IO_BATCH) {
+  // the messages only ever point to their own iovec, and to the destination
+  // address for sends. Only the iovec bases and lengths change between calls
+  for (unsigned i = 0; i < MAX_IO_BATCH; i++) {
+    memset(&sendMsgs[i], 0, sizeof(sendMsgs[i]));
+    sendMsgs[i].msg_hdr.msg_name = &this->destAddr;
+    sendMsgs[i].msg_hdr.msg_namelen = sizeof(this->destAddr);
+    sendMsgs[i].msg_hdr.msg_iov = &sendIovecs[i];
+    sendMsgs[i].msg_hdr.msg_iovlen = 1;
+
+    recvIovecs[i].iov_base = recvBuff + i * RECV_BUFFER_LEN;
+    recvIovecs[i].iov_len = RECV_BUFFER_LEN;
+    memset(&recvMsgs[i], 0, sizeof(recvMsgs[i]));
+    recvMsgs[i].msg_hdr.msg_iov = &recvIovecs[i];
+    recvMsgs[i].msg_hdr.msg_iovlen = 1;
+  }
+}
 
 UDPSocket::~UDPSocket() {
   std::cout << "destroying socket\n";
   close(sockfd);
+  delete[] recvBuff;
 }
 
 std::pair<std::unique_ptr<UDPSocket>, Err::SocketError> UDPSocket::create(const std::string& destIp, int port) {
@@ -37,6 +60,9 @@ std::pair<std::unique_ptr<UDPSocket>, Err::SocketError> UDPSocket::create(const
   int disable = 1;
   setsockopt(sockfd, SOL_SOCKET, SO_NO_CHECK, (void *)&disable, sizeof(disable));
 
+  struct timeval recvTimeout = {.tv_sec = 0, .tv_usec = RECV_TIMEOUT_MS * 1000};
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, (void *)&recvTimeout, sizeof(recvTimeout));
+
   struct sockaddr_in srcAddr = {0};
   srcAddr.sin_family = AF_INET;
   srcAddr.sin_port = htons(INADDR_ANY);
@@ -64,8 +90,8 @@ std::pair<std::unique_ptr<UDPSocket>, Err::SocketError> UDPSocket::create(const
 }
 
 Err::SocketError UDPSocket::sendPacket(struct packet *packet) {
-  int ret =
-      sendto(sockfd, (const void *)packet, sizeof(struct packet), 0, (struct sockaddr *)&destAddr, sizeof(destAddr));
+  int ret = sendto(sockfd, (const void *)packet, PACKET_SIZE(packet->num_requests), 0, (struct sockaddr *)&destAddr,
+                   sizeof(destAddr));
 
   if (ret < 0) {
     return Err::UDPFailure;
@@ -74,9 +100,41 @@ Err::SocketError UDPSocket::sendPacket(struct packet *packet) {
   return Err::NoError;
 }
 
+std::pair<size_t, Err::SocketError> UDPSocket::sendPackets(std::span<struct packet *> packets) {
+  size_t sent = 0;
+  while (sent < packets.size()) {
+    unsigned batch = std::min<size_t>(packets.size() - sent, MAX_IO_BATCH);
+    for (unsigned i = 0; i < batch; i++) {
+      sendIovecs[i].iov_base = packets[sent + i];
+      sendIovecs[i].iov_len = PACKET_SIZE(packets[sent + i]->num_requests);
+    }
+
+    // may send fewer datagrams than asked for, the rest is sent by the next call
+    int ret = sendmmsg(sockfd, sendMsgs.data(), batch, 0);
+    if (ret < 0) return {sent, Err::UDPFailure};
+    sent += ret;
+  }
+
+  return {sent, Err::NoError};
+}
+
+std::pair<size_t, Err::SocketError> UDPSocket::recvPackets() {
+  int ret = recvmmsg(sockfd, recvMsgs.data(), MAX_IO_BATCH, MSG_WAITFORONE, nullptr);
+  if (ret < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return {0, Err::RecvTimeout};
+    return {0, Err::UDPFailure};
+  }
+  return {ret, Err::NoError};
+}
+
+std::pair<char *, size_t> UDPSocket::getRecvPacket(size_t i) {
+  return {recvBuff + i * RECV_BUFFER_LEN, recvMsgs[i].msg_len};
+}
+
 std::pair<size_t, Err::SocketError> UDPSocket::recvPacket() {
   int bytesReceived;
   if ((bytesReceived = recv(sockfd, recvBuff, recvBufferSize, 0x0)) < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return {0, Err::RecvTimeout};
     return {0, Err::UDPFailure};
   }
   return {bytesReceived, Err::NoError};
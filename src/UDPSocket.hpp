@@ -7,15 +7,23 @@
 #define UDPSOCKET_H
 
 #include <netinet/in.h>
+#include <sys/socket.h>
 
 #include <memory>
+#include <span>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "../common/packet.h"
 
+// datagrams sent or received by a single sendmmsg/recvmmsg call
+#define MAX_IO_BATCH 32
+// receives give up after this long without a packet, such that receivers can stop
+#define RECV_TIMEOUT_MS 100
+
 namespace Err {
-enum SocketError { NoError = 0, SocketFdFailure, SocketBindFailure, UDPFailure, InvalidPacket };
+enum SocketError { NoError = 0, SocketFdFailure, SocketBindFailure, UDPFailure, InvalidPacket, RecvTimeout };
 }
 
 class UDPSocket {
@@ -26,6 +34,12 @@ class UDPSocket {
   char *recvBuff;
   size_t recvBufferSize;
 
+  // preallocated for batched I/O, one entry per datagram
+  std::vector<struct mmsghdr> sendMsgs;
+  std::vector<struct iovec> sendIovecs;
+  std::vector<struct mmsghdr> recvMsgs;
+  std::vector<struct iovec> recvIovecs;
+
  public:
   UDPSocket(int sockfd, struct sockaddr_in destAddr, struct sockaddr_in srcAddr);
   ~UDPSocket();
@@ -39,15 +53,41 @@ class UDPSocket {
   static std::pair<std::unique_ptr<UDPSocket>, Err::SocketError> create(const std::string& destIp, int port);
 
   /**
-   * Sends a packet to the socket's destination address.
+   * Sends a packet and the `packet->num_requests` requests following it to the
+   * socket's destination address.
    * @returns NoError = 0 on success, UDPFailure on failure
    */
   Err::SocketError sendPacket(struct packet *packet);
 
   /**
-   * Gets a packet into the socket's recvBuffer. This is blocking
+   * Sends every packet of `packets` and the requests following it as a datagram
+   * to the socket's destination address, with one sendmmsg call per
+   * MAX_IO_BATCH datagrams.
+   * @returns {packetsSent, NoError} on success, {packetsSent, UDPFailure} on failure
+   */
+  std::pair<size_t, Err::SocketError> sendPackets(std::span<struct packet *> packets);
+
+  /**
+   * Gets up to MAX_IO_BATCH packets into the socket's recvBuffer with a single
+   * recvmmsg call. Blocks until at least one packet is available, or for
+   * RECV_TIMEOUT_MS
+   *
+   * @returns {packetsReceived, NoError} on success, {0, RecvTimeout} if no
+   * packet arrived in time, {_, SocketError} on failure
+   */
+  std::pair<size_t, Err::SocketError> recvPackets();
+
+  /**
+   * @returns a pointer to the `i`-th packet received by recvPackets() and its size
+   */
+  std::pair<char *, size_t> getRecvPacket(size_t i);
+
+  /**
+   * Gets a packet into the socket's recvBuffer. This is blocking, for up to
+   * RECV_TIMEOUT_MS
    *
-   * @returns {bytesRead, NoError} on success, {_, SocketError} on failure
+   * @returns {bytesRead, NoError} on success, {0, RecvTimeout} if no packet
+   * arrived in time, {_, SocketError} on failure
    */
   std::pair<size_t, Err::SocketError> recvPacket();
 
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: MIT
+#include <gtest/gtest.h>
+
+#include <IntervalRecorder.hpp>
+#include <atomic>
+#include <thread>
+
+TEST(IntervalRecorderTest, TakesValuesSinceLastInterval) {
+  IntervalRecorder recorder;
+  recorder.record(10);
+  recorder.record(20);
+
+  LogLinearHistogram first = recorder.takeInterval();
+  EXPECT_EQ(first.getTotalCount(), 2);
+  EXPECT_EQ(first.valueAtPercentile(100), 20);
+
+  EXPECT_EQ(recorder.takeInterval().getTotalCount(), 0);
+
+  // both histograms have been swapped in once, and were reset when taken
+  recorder.record(30);
+  LogLinearHistogram third = recorder.takeInterval();
+  EXPECT_EQ(third.getTotalCount(), 1);
+  EXPECT_EQ(third.valueAtPercentile(0), 30);
+  EXPECT_EQ(recorder.takeInterval().getTotalCount(), 0);
+}
+
+TEST(IntervalRecorderTest, LosesNoValueWhileRecording) {
+  const uint64_t numValues = 1'000'000;
+  IntervalRecorder recorder;
+  std::atomic<bool> done = false;
+
+  std::thread writer([&] {
+    for (uint64_t i = 0; i < numValues; i++) recorder.record(i);
+    done = true;
+  });
+
+  uint64_t taken = 0;
+  int intervals = 0;
+  while (!done) {
+    taken += recorder.takeInterval().getTotalCount();
+    intervals++;
+  }
+  writer.join();
+  taken += recorder.takeInterval().getTotalCount();
+
+  EXPECT_EQ(taken, numValues);
+  EXPECT_GT(intervals, 0);
+}
@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: MIT
+#include <gtest/gtest.h>
+
+#include <LogLinearHistogram.hpp>
+
+/// @return the lowest value of the bucket `value` is recorded in
+static uint64_t bucketOf(uint64_t value, unsigned precisionBits = DEFAULT_HISTOGRAM_PRECISION_BITS) {
+  LogLinearHistogram hist(precisionBits);
+  hist.record(value);
+  uint64_t ret = 0;
+  hist.forEachBucket([&](uint64_t bucket, uint64_t) { ret = bucket; });
+  return ret;
+}
+
+TEST(LogLinearHistogramTest, SmallValuesAreExact) {
+  for (uint64_t value = 0; value < 2ULL << DEFAULT_HISTOGRAM_PRECISION_BITS; value++)
+    EXPECT_EQ(bucketOf(value), value);
+}
+
+TEST(LogLinearHistogramTest, BucketBoundsRelativeError) {
+  for (unsigned precisionBits : {3, 7, 10}) {
+    for (uint64_t value = 1; value < DEFAULT_HISTOGRAM_MAX_VALUE; value = value * 3 + 1) {
+      uint64_t bucket = bucketOf(value, precisionBits);
+      EXPECT_LE(bucket, value);
+      EXPECT_LT((double)(value - bucket) / value, 1.0 / (1ULL << precisionBits)) << "value " << value;
+    }
+  }
+}
+
+TEST(LogLinearHistogramTest, BucketsArePowersOfTwoSplits) {
+  // [256, 512) is split into 128 buckets of 2
+  EXPECT_EQ(bucketOf(256), 256);
+  EXPECT_EQ(bucketOf(257), 256);
+  EXPECT_EQ(bucketOf(258), 258);
+  EXPECT_EQ(bucketOf(511), 510);
+  EXPECT_EQ(bucketOf(512), 512);
+  EXPECT_EQ(bucketOf(515), 512);
+  EXPECT_EQ(bucketOf(516), 516);
+}
+
+TEST(LogLinearHistogramTest, ClampsToMaxValue) {
+  LogLinearHistogram hist(7, 1'000'000);
+  hist.record(UINT64_MAX);
+  EXPECT_EQ(hist.getTotalCount(), 1);
+  EXPECT_EQ(hist.valueAtPercentile(100), bucketOf(1'000'000));
+}
+
+TEST(LogLinearHistogramTest, Percentiles) {
+  LogLinearHistogram hist;
+  EXPECT_EQ(hist.valueAtPercentile(50), 0);
+
+  for (uint64_t value = 1; value <= 100; value++) hist.record(value);
+  EXPECT_EQ(hist.getTotalCount(), 100);
+  EXPECT_EQ(hist.valueAtPercentile(0), 1);
+  EXPECT_EQ(hist.valueAtPercentile(50), 50);
+  EXPECT_EQ(hist.valueAtPercentile(99), 99);
+  EXPECT_EQ(hist.valueAtPercentile(100), 100);
+}
+
+TEST(LogLinearHistogramTest, PercentilesOfLargeValues) {
+  LogLinearHistogram hist;
+  for (uint64_t i = 1; i <= 1000; i++) hist.record(i * 1'000'000);
+
+  for (double percentile : {50.0, 90.0, 99.0, 99.9}) {
+    double expected = percentile * 10 * 1'000'000;
+    uint64_t value = hist.valueAtPercentile(percentile);
+    EXPECT_LE(value, expected);
+    EXPECT_LT((expected - value) / expected, 1.0 / (1 << DEFAULT_HISTOGRAM_PRECISION_BITS));
+  }
+}
+
+TEST(LogLinearHistogramTest, MergeAddsCounts) {
+  LogLinearHistogram a, b;
+  a.record(10, 3);
+  b.record(10);
+  b.record(1000);
+  ASSERT_EQ(a.mergeWith(b), 0);
+  EXPECT_EQ(a.getTotalCount(), 5);
+  EXPECT_EQ(a.valueAtPercentile(80), 10);
+  EXPECT_EQ(a.valueAtPercentile(100), bucketOf(1000));
+
+  LogLinearHistogram otherPrecision(5);
+  EXPECT_EQ(a.mergeWith(otherPrecision), -1);
+  EXPECT_EQ(a.getTotalCount(), 5);
+}
+
+TEST(LogLinearHistogramTest, Reset) {
+  LogLinearHistogram hist;
+  hist.record(42);
+  hist.reset();
+  EXPECT_EQ(hist.getTotalCount(), 0);
+  EXPECT_EQ(hist.valueAtPercentile(50), 0);
+}
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: MIT
+#include <gtest/gtest.h>
+
+#include <SequenceTracker.hpp>
+
+TEST(SequenceTrackerTest, InOrderCountsNothing) {
+  SequenceTracker tracker;
+  for (uint32_t id = 0; id < 1000; id++) tracker.record(id, id, id);
+  tracker.flush();
+
+  DeliveryCounts counts = tracker.takeCounts();
+  EXPECT_EQ(counts.lost, 0);
+  EXPECT_EQ(counts.reordered, 0);
+  EXPECT_EQ(counts.duplicates, 0);
+  EXPECT_EQ(counts.late, 0);
+}
+
+TEST(SequenceTrackerTest, CountsDuplicatesAndReordered) {
+  SequenceTracker tracker;
+  tracker.record(0, 0, 0);
+  tracker.record(2, 0, 0);
+  tracker.record(1, 0, 0);
+  tracker.record(1, 0, 0);
+  tracker.record(2, 0, 0);
+  tracker.flush();
+
+  DeliveryCounts counts = tracker.takeCounts();
+  EXPECT_EQ(counts.lost, 0);
+  EXPECT_EQ(counts.reordered, 1);
+  EXPECT_EQ(counts.duplicates, 2);
+  EXPECT_EQ(counts.late, 0);
+}
+
+TEST(SequenceTrackerTest, CountsLossAfterTimeout) {
+  SequenceTracker tracker(1024, 100);
+  tracker.record(0, 0, 0);
+  tracker.record(2, 10, 10);
+  tracker.record(3, 200, 200);
+  // id 1 is missing, but no received id below it was sent long enough ago
+  EXPECT_EQ(tracker.takeCounts().lost, 0);
+
+  tracker.record(4, 400, 400);
+  EXPECT_EQ(tracker.takeCounts().lost, 1);
+
+  tracker.record(1, 5, 401);
+  DeliveryCounts counts = tracker.takeCounts();
+  EXPECT_EQ(counts.late, 1);
+  EXPECT_EQ(counts.reordered, 0);
+}
+
+TEST(SequenceTrackerTest, EvictsIdsLeavingTheWindow) {
+  SequenceTracker tracker(64, UINT64_MAX / 2);
+  tracker.record(0, 0, 0);
+  tracker.record(100, 0, 0);
+  // ids up to 100 - 64 left the window
+  EXPECT_EQ(tracker.takeCounts().lost, 36);
+
+  tracker.record(50, 0, 0);
+  DeliveryCounts counts = tracker.takeCounts();
+  EXPECT_EQ(counts.reordered, 1);
+  EXPECT_EQ(counts.lost, 0);
+
+  tracker.record(5, 0, 0);
+  EXPECT_EQ(tracker.takeCounts().late, 1);
+
+  tracker.flush();
+  EXPECT_EQ(tracker.takeCounts().lost, 62);
+}
+
+TEST(SequenceTrackerTest, CountsLargeJumpsAsLost) {
+  SequenceTracker tracker(64, UINT64_MAX / 2);
+  tracker.record(0, 0, 0);
+  tracker.record(1'000'000, 0, 0);
+  tracker.flush();
+  EXPECT_EQ(tracker.takeCounts().lost, 999'999);
+}
+
+TEST(SequenceTrackerTest, HandlesWrapAround) {
+  const uint64_t step = 1 << 20;
+  const uint64_t last = (1ULL << 32) + 2 * step;
+  SequenceTracker tracker(64, UINT64_MAX / 2);
+  for (uint64_t pos = 0; pos <= last; pos += step) tracker.record(pos, 0, 0);
+  // extended past the wrap-around, not taken for an id of the first round
+  tracker.record((uint32_t)last, 0, 0);
+  tracker.flush();
+
+  DeliveryCounts counts = tracker.takeCounts();
+  EXPECT_EQ(counts.duplicates, 1);
+  EXPECT_EQ(counts.lost, last - last / step);
+  EXPECT_EQ(counts.late, 0);
+}
+
+TEST(SequenceTrackerTest, TakeCountsResets) {
+  SequenceTracker tracker;
+  tracker.record(0, 0, 0);
+  tracker.record(0, 0, 0);
+  EXPECT_EQ(tracker.takeCounts().duplicates, 1);
+  EXPECT_EQ(tracker.takeCounts().duplicates, 0);
+}